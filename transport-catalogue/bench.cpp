@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "city_generator.h"
+#include "json.h"
+#include "json_reader.h"
+#include "map_renderer.h"
+#include "request_handler.h"
+#include "response_cache.h"
+#include "serialization.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+using namespace std::literals;
+
+namespace {
+
+// Вывод, который только считает байты (как /dev/null, но без системных вызовов)
+class NullBuffer : public std::streambuf {
+public:
+    NullBuffer() {
+        setp(buffer_, buffer_ + sizeof(buffer_));
+    }
+
+    size_t GetSize() const {
+        return size_ + (pptr() - pbase());
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        size_ += pptr() - pbase();
+        setp(buffer_, buffer_ + sizeof(buffer_));
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+private:
+    char buffer_[1 << 16];
+    size_t size_ = 0;
+};
+
+// Все, что нужно для базы, связанное так же, как в main
+struct Base {
+    transport_catalogue::TransportCatalogue catalogue;
+    map_renderer::MapRenderer renderer;
+    transport_router::TransportRouter router{catalogue};
+    response_cache::ResponseCache responses;
+    serialization::Serializator serializator{catalogue, renderer, router, responses};
+    json_reader::JsonReader reader{catalogue, renderer, router, serializator, responses};
+
+    // load_threads - потоков для чтения базы (0 - по числу ядер)
+    Base(const std::string& db_path, size_t load_threads) {
+        router.SetSettings(city_generator::MakeRouterSettings());
+        renderer.SetSettings(city_generator::MakeRenderSettings());
+
+        serialization::SerializatorSettings settings;
+        settings.path = db_path;
+        settings.threads = load_threads;
+        serializator.SetSettings(settings);
+    }
+};
+
+// Заполняет каталог тем же кодом, что и make_base: JSON базы через JsonReader
+void AddCity(Base& base, const std::string& base_json) {
+    std::istringstream input(base_json);
+    base.reader.GeneralLoadBase(input);
+    base.reader.BuildCatalogue();
+}
+
+std::unique_ptr<Base> MakeBase(const std::string& base_json, const std::string& db_path, size_t load_threads,
+                               bool with_router) {
+    auto base = std::make_unique<Base>(db_path, load_threads);
+    AddCity(*base, base_json);
+    base->reader.BuildBusInfo();
+    if (with_router) {
+        base->router.CalcRoute();
+    }
+    return base;
+}
+
+// сюда пишутся результаты, которые иначе оптимизатор мог бы не вычислять
+volatile size_t sink = 0;
+
+struct Result {
+    std::string name;
+    size_t items = 0; // обработано за прогон: запросов, остановок, маршрутов
+    size_t bytes = 0; // выведено или прочитано за прогон
+    std::vector<double> times; // мс
+};
+
+// prepare() готовит данные прогона вне замера, run(data, result) замеряется
+template <typename Prepare, typename Run>
+Result Measure(std::string name, size_t repeat, Prepare prepare, Run run) {
+    Result result;
+    result.name = std::move(name);
+
+    for (size_t i = 0; i < repeat; ++i) {
+        auto data = prepare();
+
+        const auto start = std::chrono::steady_clock::now();
+        run(data, result);
+        const auto end = std::chrono::steady_clock::now();
+
+        result.times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    std::cerr << result.name << ' ' << *std::min_element(result.times.begin(), result.times.end()) << " ms\n"sv;
+    return result;
+}
+
+void PrintResults(std::ostream& out, const city_generator::CitySettings& settings, size_t load_threads,
+                  const std::vector<Result>& results) {
+    json::Writer writer(out);
+
+    writer.StartDict().Key("benchmarks"sv).StartArray();
+    for (const Result& result : results) {
+        std::vector<double> times = result.times;
+        std::sort(times.begin(), times.end());
+        const double median = times.size() % 2 ? times[times.size() / 2]
+                                                : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+        const double mean = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+
+        writer.StartDict().
+            Key("bytes"sv).Value(static_cast<uint64_t>(result.bytes)).
+            Key("items"sv).Value(static_cast<uint64_t>(result.items)).
+            Key("items_per_second"sv).Value(median > 0 ? result.items / median * 1000.0 : 0.0).
+            Key("max_ms"sv).Value(times.back()).
+            Key("mean_ms"sv).Value(mean).
+            Key("median_ms"sv).Value(median).
+            Key("min_ms"sv).Value(times.front()).
+            Key("name"sv).Value(result.name).
+            Key("repeat"sv).Value(static_cast<uint64_t>(times.size())).
+            EndDict();
+    }
+    writer.EndArray().
+        Key("city"sv).StartDict().
+        Key("buses"sv).Value(static_cast<uint64_t>(settings.buses)).
+        Key("distance_density"sv).Value(settings.distance_density).
+        Key("max_route_stops"sv).Value(static_cast<uint64_t>(settings.max_route_stops)).
+        Key("min_route_stops"sv).Value(static_cast<uint64_t>(settings.min_route_stops)).
+        Key("miss_ratio"sv).Value(settings.miss_ratio).
+        Key("requests"sv).Value(static_cast<uint64_t>(settings.requests)).
+        Key("roundtrip_ratio"sv).Value(settings.roundtrip_ratio).
+        Key("seed"sv).Value(static_cast<uint64_t>(settings.seed)).
+        Key("stops"sv).Value(static_cast<uint64_t>(settings.stops)).
+        EndDict().
+        Key("hardware_threads"sv).Value(static_cast<uint64_t>(std::thread::hardware_concurrency())).
+        Key("load_threads"sv).Value(static_cast<uint64_t>(load_threads)).
+        EndDict();
+    out << '\n';
+}
+
+std::vector<Result> RunBenchmarks(const city_generator::City& city, const std::string& db_path, size_t load_threads,
+                                  size_t repeat) {
+    std::ostringstream base_stream;
+    city_generator::PrintBaseRequests(city, db_path, load_threads, base_stream);
+    const std::string base_json = base_stream.str();
+
+    std::ostringstream requests_stream;
+    city_generator::PrintStatRequests(city, db_path, load_threads, requests_stream);
+    const std::string requests_json = requests_stream.str();
+
+    const size_t stop_count = city.stops.size();
+    const size_t bus_count = city.buses.size();
+    auto no_data = [] {
+        return 0;
+    };
+    auto empty_base = [&db_path, load_threads] {
+        return std::make_unique<Base>(db_path, load_threads);
+    };
+    auto full_base = [&base_json, &db_path, load_threads] {
+        return MakeBase(base_json, db_path, load_threads, true);
+    };
+
+    std::vector<Result> results;
+
+    // разбор JSON в документ
+    results.push_back(Measure("json_load"s, repeat, no_data, [&](int, Result& result) {
+        std::istringstream input(base_json);
+        json::Load(input);
+        result.items = stop_count + bus_count;
+        result.bytes = base_json.size();
+    }));
+
+    // make_base целиком: разбор, каталог, маршрутизатор, запись базы
+    results.push_back(Measure("make_base"s, repeat, empty_base, [&](auto& base, Result& result) {
+        std::istringstream input(base_json);
+        base->reader.GeneralLoadBase(input);
+        base->reader.Parse();
+        result.items = stop_count + bus_count;
+        result.bytes = base_json.size();
+    }));
+
+    // разбор JSON и заполнение каталога без маршрутизатора и записи базы
+    results.push_back(Measure("catalogue_build"s, repeat, empty_base, [&](auto& base, Result& result) {
+        AddCity(*base, base_json);
+        result.items = stop_count + bus_count;
+        result.bytes = base_json.size();
+    }));
+
+    results.push_back(Measure("bus_info"s, repeat,
+        [&] {
+            auto base = std::make_unique<Base>(db_path, load_threads);
+            AddCity(*base, base_json);
+            return base;
+        },
+        [&](auto& base, Result& result) {
+            base->reader.BuildBusInfo();
+            result.items = bus_count;
+        }));
+
+    results.push_back(Measure("router_build"s, repeat,
+        [&] {
+            return MakeBase(base_json, db_path, load_threads, false);
+        },
+        [&](auto& base, Result& result) {
+            base->router.CalcRoute();
+            result.items = stop_count;
+        }));
+
+    // маршрутизатор строится один раз, замеряются только ответы
+    const std::unique_ptr<Base> routed = MakeBase(base_json, db_path, load_threads, true);
+    results.push_back(Measure("route_queries"s, repeat, no_data, [&](int, Result& result) {
+        size_t count = 0;
+        size_t edges = 0;
+        for (const city_generator::StatRequest& request : city.requests) {
+            if (request.type == "Route"sv) {
+                if (auto route = routed->router.GetRoute(request.from, request.to)) {
+                    edges += route->size();
+                }
+                ++count;
+            }
+        }
+        result.items = count;
+        sink = edges;
+    }));
+
+    // запросы Stop и Bus по одному в строке, как в serve; доля несуществующих
+    // имен задается --miss-ratio, готовых ответов в кэше нет
+    std::vector<std::string> lookup_lines;
+    for (const city_generator::StatRequest& request : city.requests) {
+        if (request.type == "Stop"sv || request.type == "Bus"sv) {
+            std::ostringstream line;
+            json::Writer(line, false).StartDict().
+                Key("id"sv).Value(static_cast<int>(lookup_lines.size())).
+                Key("name"sv).Value(request.from).
+                Key("type"sv).Value(request.type).
+                EndDict();
+            lookup_lines.push_back(line.str());
+        }
+    }
+    results.push_back(Measure("stop_bus_requests"s, repeat, no_data, [&](int, Result& result) {
+        NullBuffer buffer;
+        std::ostream out(&buffer);
+        request_handler::RequestHandler handler(routed->catalogue, routed->renderer, routed->router);
+        for (const std::string& line : lookup_lines) {
+            routed->reader.ProcessRequest(line, out, handler);
+        }
+        result.items = lookup_lines.size();
+        result.bytes = buffer.GetSize();
+    }));
+
+    results.push_back(Measure("map_render"s, repeat, full_base, [&](auto& base, Result& result) {
+        NullBuffer buffer;
+        std::ostream out(&buffer);
+        request_handler::RequestHandler handler(base->catalogue, base->renderer, base->router);
+        handler.PrepareRender();
+        handler.RenderMap(out);
+        result.items = stop_count + bus_count;
+        result.bytes = buffer.GetSize();
+    }));
+
+    // повторные запросы Map к одному обработчику: карта выводится один раз
+    // (в первом прогоне), дальше каждый ответ - копия готовой строки, и время
+    // на запрос не зависит от их числа
+    const size_t map_request_count = 100;
+    request_handler::RequestHandler map_handler(routed->catalogue, routed->renderer, routed->router);
+    map_handler.PrepareRender();
+    results.push_back(Measure("map_repeated"s, repeat, no_data, [&](int, Result& result) {
+        NullBuffer buffer;
+        std::ostream out(&buffer);
+        for (size_t i = 0; i < map_request_count; ++i) {
+            std::ostringstream line;
+            json::Writer(line, false).StartDict().
+                Key("id"sv).Value(static_cast<int>(i)).
+                Key("type"sv).Value("Map"sv).
+                EndDict();
+            routed->reader.ProcessRequest(line.str(), out, map_handler);
+        }
+        result.items = map_request_count;
+        result.bytes = buffer.GetSize();
+    }));
+
+    results.push_back(Measure("serialize"s, repeat, full_base, [&](auto& base, Result& result) {
+        base->serializator.Serialize();
+        result.items = stop_count + bus_count;
+        result.bytes = std::filesystem::file_size(db_path);
+    }));
+
+    results.push_back(Measure("deserialize"s, repeat, empty_base, [&](auto& base, Result& result) {
+        if (!base->serializator.Deserialize()) {
+            throw std::runtime_error("cannot read base "s + db_path);
+        }
+        result.items = stop_count + bus_count;
+        result.bytes = std::filesystem::file_size(db_path);
+    }));
+
+    // process_requests целиком: чтение базы и ответы без отступов
+    results.push_back(Measure("process_requests"s, repeat, empty_base, [&](auto& base, Result& result) {
+        std::istringstream input(requests_json);
+        base->reader.GeneralLoadRequests(input);
+
+        NullBuffer buffer;
+        std::ostream out(&buffer);
+        request_handler::RequestHandler handler(base->catalogue, base->renderer, base->router);
+        handler.PrepareRender();
+        base->reader.Print(out, handler, true);
+        result.items = city.requests.size();
+        result.bytes = buffer.GetSize();
+    }));
+
+    return results;
+}
+
+void PrintUsage(std::ostream& stream = std::cerr) {
+    stream << "Usage: transport_catalogue_bench [--seed N] [--stops N] [--buses N] [--route-stops MIN MAX]\n"sv;
+    stream << "                                 [--roundtrip RATIO] [--density D] [--requests N] [--miss-ratio RATIO]\n"sv;
+    stream << "                                 [--repeat N] [--load-threads N] [--db FILE] [--out FILE]\n"sv;
+    stream << "                                 [--write-base FILE] [--write-requests FILE]\n"sv;
+}
+
+size_t ReadCount(const char* value) {
+    return static_cast<size_t>(std::max(std::atoi(value), 0));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    city_generator::CitySettings settings;
+    size_t repeat = 5;
+    size_t load_threads = 0;
+    std::string db_path = (std::filesystem::temp_directory_path() / "transport_catalogue_bench.db").string();
+    // пусто - в stdout
+    std::string out_path;
+    // только записать JSON города и выйти
+    std::string base_path;
+    std::string requests_path;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg(argv[i]);
+        if (arg == "--seed"sv && i + 1 < argc) {
+            settings.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--stops"sv && i + 1 < argc) {
+            settings.stops = ReadCount(argv[++i]);
+        } else if (arg == "--buses"sv && i + 1 < argc) {
+            settings.buses = ReadCount(argv[++i]);
+        } else if (arg == "--route-stops"sv && i + 2 < argc) {
+            settings.min_route_stops = ReadCount(argv[++i]);
+            settings.max_route_stops = ReadCount(argv[++i]);
+        } else if (arg == "--roundtrip"sv && i + 1 < argc) {
+            settings.roundtrip_ratio = std::atof(argv[++i]);
+        } else if (arg == "--density"sv && i + 1 < argc) {
+            settings.distance_density = std::max(std::atof(argv[++i]), 0.0);
+        } else if (arg == "--requests"sv && i + 1 < argc) {
+            settings.requests = ReadCount(argv[++i]);
+        } else if (arg == "--miss-ratio"sv && i + 1 < argc) {
+            settings.miss_ratio = std::clamp(std::atof(argv[++i]), 0.0, 1.0);
+        } else if (arg == "--repeat"sv && i + 1 < argc) {
+            repeat = std::max<size_t>(ReadCount(argv[++i]), 1);
+        } else if (arg == "--load-threads"sv && i + 1 < argc) {
+            load_threads = ReadCount(argv[++i]);
+        } else if (arg == "--db"sv && i + 1 < argc) {
+            db_path = argv[++i];
+        } else if (arg == "--out"sv && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (arg == "--write-base"sv && i + 1 < argc) {
+            base_path = argv[++i];
+        } else if (arg == "--write-requests"sv && i + 1 < argc) {
+            requests_path = argv[++i];
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    const city_generator::City city = city_generator::Generate(settings);
+
+    if (!base_path.empty() || !requests_path.empty()) {
+        if (!base_path.empty()) {
+            std::ofstream out(base_path);
+            city_generator::PrintBaseRequests(city, db_path, load_threads, out);
+        }
+        if (!requests_path.empty()) {
+            std::ofstream out(requests_path);
+            city_generator::PrintStatRequests(city, db_path, load_threads, out);
+        }
+        return 0;
+    }
+
+    if (city.stops.size() < 2 || city.buses.empty()) {
+        std::cerr << "need at least 2 stops and 1 bus\n"sv;
+        return 1;
+    }
+
+    try {
+        const std::vector<Result> results = RunBenchmarks(city, db_path, load_threads, repeat);
+        if (out_path.empty()) {
+            PrintResults(std::cout, settings, load_threads, results);
+        } else {
+            std::ofstream out(out_path);
+            PrintResults(out, settings, load_threads, results);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,437 @@
+#include "city_generator.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <map>
+#include <random>
+#include <string_view>
+#include <variant>
+
+#include "json.h"
+
+namespace city_generator {
+
+using namespace std::literals;
+
+namespace {
+
+// центр города и шаг между остановками
+constexpr double CENTER_LAT = 55.75;
+constexpr double CENTER_LNG = 37.62;
+constexpr double STOP_SPACING = 300.0; // м
+constexpr double METERS_PER_DEGREE = 111195.0;
+
+// настройки маршрутизации в единицах запроса: минуты и км/ч
+constexpr int BUS_WAIT_TIME = 6;
+constexpr int BUS_VELOCITY = 40;
+
+constexpr double PI = 3.14159265358979323846;
+
+// std::mt19937 выдает одинаковую последовательность везде, в отличие от распределений
+class Random {
+public:
+    explicit Random(uint32_t seed)
+        : engine_(seed) {
+    }
+
+    // [0, count)
+    size_t Below(size_t count) {
+        return static_cast<size_t>(engine_()) % count;
+    }
+
+    // [from, to)
+    double Uniform(double from = 0.0, double to = 1.0) {
+        return from + (to - from) * (engine_() / 4294967296.0);
+    }
+
+private:
+    std::mt19937 engine_;
+};
+
+// Остановки в квадратных ячейках со стороной в два шага: соседей ищем
+// в ближайших ячейках, а не перебором всех остановок
+class Grid {
+public:
+    Grid(double side, double cell)
+        : cell_(cell)
+        , size_(std::max<int>(1, static_cast<int>(std::ceil(side / cell))))
+        , cells_(size_ * size_) {
+    }
+
+    void Add(size_t stop, double x, double y) {
+        cells_[GetCell(x) * size_ + GetCell(y)].push_back(stop);
+    }
+
+    // остановки в ячейках не дальше radius от ячейки точки
+    template <typename Func>
+    void ForEachNear(double x, double y, int radius, Func func) const {
+        const int cx = GetCell(x);
+        const int cy = GetCell(y);
+        for (int i = std::max(0, cx - radius); i <= std::min(size_ - 1, cx + radius); ++i) {
+            for (int j = std::max(0, cy - radius); j <= std::min(size_ - 1, cy + radius); ++j) {
+                for (size_t stop : cells_[i * size_ + j]) {
+                    func(stop);
+                }
+            }
+        }
+    }
+
+private:
+    double cell_;
+    int size_;
+    std::vector<std::vector<size_t>> cells_;
+
+    int GetCell(double value) const {
+        return std::clamp(static_cast<int>(value / cell_), 0, size_ - 1);
+    }
+};
+
+class Generator {
+public:
+    explicit Generator(const CitySettings& settings)
+        : settings_(settings)
+        , random_(settings.seed)
+        , side_(std::sqrt(static_cast<double>(std::max<size_t>(settings.stops, 2))) * STOP_SPACING)
+        , grid_(side_, 2 * STOP_SPACING) {
+    }
+
+    City Generate() {
+        AddStops();
+        AddBuses();
+        AddNeighbourDistances();
+        AddRequests();
+        return std::move(city_);
+    }
+
+private:
+    const CitySettings& settings_;
+    Random random_;
+    double side_;
+    Grid grid_;
+
+    // координаты остановок в метрах от угла города
+    std::vector<double> x_;
+    std::vector<double> y_;
+    // уже заданные дорожные расстояния, в любом направлении
+    std::map<std::pair<size_t, size_t>, int> roads_;
+
+    City city_;
+
+    static constexpr std::string_view STREETS[] = {
+        "Lenina"sv, "Sadovaya"sv, "Lesnaya"sv, "Shkolnaya"sv, "Sovetskaya"sv, "Mira"sv,
+        "Naberezhnaya"sv, "Polevaya"sv, "Zarechnaya"sv, "Sportivnaya"sv, "Molodezhnaya"sv, "Tsentralnaya"sv
+    };
+    static constexpr std::string_view KINDS[] = {
+        "street"sv, "avenue"sv, "square"sv, "lane"sv
+    };
+
+    void AddStops() {
+        const double lng_scale = METERS_PER_DEGREE * std::cos(CENTER_LAT * PI / 180.0);
+
+        city_.stops.reserve(settings_.stops);
+        for (size_t i = 0; i < settings_.stops; ++i) {
+            const double x = random_.Uniform(0.0, side_);
+            const double y = random_.Uniform(0.0, side_);
+            x_.push_back(x);
+            y_.push_back(y);
+            grid_.Add(i, x, y);
+
+            Stop stop;
+            stop.name = std::string(STREETS[random_.Below(std::size(STREETS))]) + ' '
+                      + std::string(KINDS[random_.Below(std::size(KINDS))]) + ' ' + std::to_string(i + 1);
+            // координаты с точностью около 1 см, как в реальных данных
+            stop.coordinates.lat = std::round((CENTER_LAT + (y - side_ / 2) / METERS_PER_DEGREE) * 1e7) / 1e7;
+            stop.coordinates.lng = std::round((CENTER_LNG + (x - side_ / 2) / lng_scale) * 1e7) / 1e7;
+            city_.stops.push_back(std::move(stop));
+        }
+    }
+
+    void AddRoad(size_t from, size_t to) {
+        if (from == to || roads_.count({from, to}) || roads_.count({to, from})) {
+            return;
+        }
+        const double distance = geo_coord::ComputeDistance(city_.stops[from].coordinates, city_.stops[to].coordinates);
+        const int road = std::max(1, static_cast<int>(std::ceil(distance * random_.Uniform(1.1, 1.6))));
+        roads_[{from, to}] = road;
+        city_.stops[from].distances.emplace_back(city_.stops[to].name, road);
+    }
+
+    // ближайшая к точке остановка не из маршрута; settings_.stops, если рядом нет
+    size_t FindNear(double x, double y, const std::vector<size_t>& route) const {
+        size_t best = settings_.stops;
+        double best_distance = 0.0;
+        for (int radius = 1; radius <= 2 && best == settings_.stops; ++radius) {
+            grid_.ForEachNear(x, y, radius, [&](size_t stop) {
+                if (std::find(route.begin(), route.end(), stop) != route.end()) {
+                    return;
+                }
+                const double distance = std::hypot(x_[stop] - x, y_[stop] - y);
+                if (best == settings_.stops || distance < best_distance) {
+                    best = stop;
+                    best_distance = distance;
+                }
+            });
+        }
+        return best;
+    }
+
+    std::vector<size_t> MakeRoute(bool is_roundtrip) {
+        const size_t min_stops = std::max<size_t>(2, settings_.min_route_stops);
+        const size_t length = min_stops + random_.Below(std::max(settings_.max_route_stops, min_stops) - min_stops + 1);
+
+        std::vector<size_t> route{random_.Below(settings_.stops)};
+        double heading = random_.Uniform(0.0, 2 * PI);
+
+        while (route.size() < length) {
+            // кольцевой маршрут равномерно поворачивает и замыкается, остальные идут почти прямо
+            heading += is_roundtrip ? 2 * PI / length + random_.Uniform(-0.2, 0.2) : random_.Uniform(-0.4, 0.4);
+
+            const size_t last = route.back();
+            double x = x_[last] + 1.5 * STOP_SPACING * std::cos(heading);
+            double y = y_[last] + 1.5 * STOP_SPACING * std::sin(heading);
+            // у края города разворачиваемся
+            if (x < 0 || x > side_ || y < 0 || y > side_) {
+                heading += PI;
+                x = std::clamp(x, 0.0, side_);
+                y = std::clamp(y, 0.0, side_);
+            }
+
+            const size_t next = FindNear(x, y, route);
+            if (next == settings_.stops) {
+                break;
+            }
+            route.push_back(next);
+        }
+
+        // одна остановка бывает только при очень редкой сети
+        if (route.size() == 1) {
+            route.push_back(route.front() == 0 ? std::min<size_t>(1, settings_.stops - 1) : 0);
+        }
+        return route;
+    }
+
+    void AddBuses() {
+        if (settings_.stops < 2) {
+            return;
+        }
+
+        city_.buses.reserve(settings_.buses);
+        for (size_t i = 0; i < settings_.buses; ++i) {
+            Bus bus;
+            bus.name = std::to_string(i + 1) + (i % 7 == 3 ? "K"s : ""s);
+            bus.is_roundtrip = random_.Uniform() < settings_.roundtrip_ratio;
+
+            std::vector<size_t> route = MakeRoute(bus.is_roundtrip);
+            if (bus.is_roundtrip) {
+                route.push_back(route.front());
+            }
+            for (size_t j = 0; j + 1 < route.size(); ++j) {
+                AddRoad(route[j], route[j + 1]);
+            }
+
+            bus.stops.reserve(route.size());
+            for (size_t stop : route) {
+                bus.stops.push_back(city_.stops[stop].name);
+            }
+            city_.buses.push_back(std::move(bus));
+        }
+    }
+
+    // дороги между соседними остановками, по которым маршруты не ходят
+    void AddNeighbourDistances() {
+        if (settings_.stops < 2) {
+            return;
+        }
+
+        std::vector<size_t> near;
+        for (size_t stop = 0; stop < settings_.stops; ++stop) {
+            const double whole = std::floor(settings_.distance_density);
+            const size_t count = static_cast<size_t>(whole)
+                               + (random_.Uniform() < settings_.distance_density - whole ? 1 : 0);
+
+            near.clear();
+            grid_.ForEachNear(x_[stop], y_[stop], 1, [&near](size_t other) {
+                near.push_back(other);
+            });
+            for (size_t i = 0; i < count && !near.empty(); ++i) {
+                AddRoad(stop, near[random_.Below(near.size())]);
+            }
+        }
+    }
+
+    void AddRequests() {
+        if (city_.stops.empty() || city_.buses.empty()) {
+            return;
+        }
+
+        city_.requests.reserve(settings_.requests);
+        for (size_t i = 0; i < settings_.requests; ++i) {
+            const double kind = random_.Uniform();
+            const bool missing = random_.Uniform() < settings_.miss_ratio;
+
+            StatRequest request;
+            if (kind < 0.3) {
+                request.type = "Stop"s;
+                request.from = missing ? "Missing stop "s + std::to_string(i)
+                                       : city_.stops[random_.Below(city_.stops.size())].name;
+            } else if (kind < 0.6) {
+                request.type = "Bus"s;
+                request.from = missing ? "Missing bus "s + std::to_string(i)
+                                       : city_.buses[random_.Below(city_.buses.size())].name;
+            } else if (kind < 0.99) {
+                request.type = "Route"s;
+                request.from = city_.stops[random_.Below(city_.stops.size())].name;
+                request.to = city_.stops[random_.Below(city_.stops.size())].name;
+            } else {
+                request.type = "Map"s;
+            }
+            city_.requests.push_back(std::move(request));
+        }
+    }
+};
+
+// координаты без потери точности (Writer::Value(double) оставляет 6 значащих цифр)
+void PrintCoordinate(json::Writer& writer, double value) {
+    char buffer[32];
+    auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value);
+    writer.RawValue(std::string_view(buffer, ptr - buffer));
+}
+
+void PrintColor(json::Writer& writer, const svg::Color& color) {
+    if (const auto* name = std::get_if<std::string>(&color)) {
+        writer.Value(*name);
+    } else if (const auto* rgb = std::get_if<svg::Rgb>(&color)) {
+        writer.StartArray().Value(rgb->red).Value(rgb->green).Value(rgb->blue).EndArray();
+    } else if (const auto* rgba = std::get_if<svg::Rgba>(&color)) {
+        writer.StartArray().Value(rgba->red).Value(rgba->green).Value(rgba->blue).Value(rgba->opacity).EndArray();
+    } else {
+        writer.Value("none"sv);
+    }
+}
+
+void PrintSerializationSettings(json::Writer& writer, const std::string& db_path, size_t threads) {
+    writer.Key("serialization_settings"sv).StartDict().Key("file"sv).Value(db_path);
+    if (threads > 0) {
+        writer.Key("threads"sv).Value(static_cast<int>(threads));
+    }
+    writer.EndDict();
+}
+
+} // namespace
+
+City Generate(const CitySettings& settings) {
+    return Generator(settings).Generate();
+}
+
+transport_router::RouterSettings MakeRouterSettings() {
+    transport_router::RouterSettings settings;
+    settings.bus_wait_time = BUS_WAIT_TIME * 60; // секунды
+    settings.bus_velocity = BUS_VELOCITY / 3.6; // м/с
+    return settings;
+}
+
+map_renderer::RenderSettings MakeRenderSettings() {
+    map_renderer::RenderSettings settings;
+    settings.width = 1200.0;
+    settings.height = 1200.0;
+    settings.padding = 50.0;
+    settings.line_width = 14.0;
+    settings.stop_radius = 5.0;
+    settings.bus_label_font_size = 20;
+    settings.bus_label_offset[0] = 7.0;
+    settings.bus_label_offset[1] = 15.0;
+    settings.stop_label_font_size = 18;
+    settings.stop_label_offset[0] = 7.0;
+    settings.stop_label_offset[1] = -3.0;
+    settings.underlayer_color = svg::Rgba{255, 255, 255, 0.85};
+    settings.underlayer_width = 3.0;
+    settings.color_palette = {"green"s, svg::Rgb{255, 160, 0}, "red"s, "navy"s, svg::Rgb{128, 0, 128}, "teal"s};
+    return settings;
+}
+
+void PrintBaseRequests(const City& city, const std::string& db_path, size_t threads, std::ostream& out) {
+    const map_renderer::RenderSettings render = MakeRenderSettings();
+    const transport_router::RouterSettings routing = MakeRouterSettings();
+
+    // ключи в алфавитном порядке; без отступов, базы бывают большими
+    json::Writer writer(out, false);
+    writer.StartDict().Key("base_requests"sv).StartArray();
+
+    for (const Stop& stop : city.stops) {
+        writer.StartDict().Key("latitude"sv);
+        PrintCoordinate(writer, stop.coordinates.lat);
+        writer.Key("longitude"sv);
+        PrintCoordinate(writer, stop.coordinates.lng);
+        writer.Key("name"sv).Value(stop.name).Key("road_distances"sv).StartDict();
+        for (const auto& [name, distance] : stop.distances) {
+            writer.Key(name).Value(distance);
+        }
+        writer.EndDict().Key("type"sv).Value("Stop"sv).EndDict();
+    }
+
+    for (const Bus& bus : city.buses) {
+        writer.StartDict().
+            Key("is_roundtrip"sv).Value(bus.is_roundtrip).
+            Key("name"sv).Value(bus.name).
+            Key("stops"sv).StartArray();
+        for (const std::string& stop : bus.stops) {
+            writer.Value(stop);
+        }
+        writer.EndArray().Key("type"sv).Value("Bus"sv).EndDict();
+    }
+
+    writer.EndArray().Key("render_settings"sv).StartDict().
+        Key("bus_label_font_size"sv).Value(render.bus_label_font_size).
+        Key("bus_label_offset"sv).StartArray().Value(render.bus_label_offset[0]).Value(render.bus_label_offset[1]).EndArray().
+        Key("color_palette"sv).StartArray();
+    for (const svg::Color& color : render.color_palette) {
+        PrintColor(writer, color);
+    }
+    writer.EndArray().
+        Key("height"sv).Value(render.height).
+        Key("line_width"sv).Value(render.line_width).
+        Key("padding"sv).Value(render.padding).
+        Key("stop_label_font_size"sv).Value(render.stop_label_font_size).
+        Key("stop_label_offset"sv).StartArray().Value(render.stop_label_offset[0]).Value(render.stop_label_offset[1]).EndArray().
+        Key("stop_radius"sv).Value(render.stop_radius).
+        Key("underlayer_color"sv);
+    PrintColor(writer, render.underlayer_color);
+    writer.
+        Key("underlayer_width"sv).Value(render.underlayer_width).
+        Key("width"sv).Value(render.width).
+        EndDict().
+        Key("routing_settings"sv).StartDict().
+        Key("bus_velocity"sv).Value(static_cast<int>(std::lround(routing.bus_velocity * 3.6))).
+        Key("bus_wait_time"sv).Value(routing.bus_wait_time / 60).
+        EndDict();
+    PrintSerializationSettings(writer, db_path, threads);
+    writer.EndDict();
+}
+
+void PrintStatRequests(const City& city, const std::string& db_path, size_t threads, std::ostream& out) {
+    json::Writer writer(out, false);
+    writer.StartDict();
+    PrintSerializationSettings(writer, db_path, threads);
+    writer.Key("stat_requests"sv).StartArray();
+
+    int id = 1;
+    for (const StatRequest& request : city.requests) {
+        writer.StartDict();
+        if (request.type == "Route"sv) {
+            writer.Key("from"sv).Value(request.from);
+        }
+        writer.Key("id"sv).Value(id++);
+        if (request.type == "Stop"sv || request.type == "Bus"sv) {
+            writer.Key("name"sv).Value(request.from);
+        }
+        if (request.type == "Route"sv) {
+            writer.Key("to"sv).Value(request.to);
+        }
+        writer.Key("type"sv).Value(request.type).EndDict();
+    }
+
+    writer.EndArray().EndDict();
+}
+
+} // namespace city_generator
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "geo.h"
+#include "map_renderer.h"
+#include "transport_router.h"
+
+namespace city_generator {
+
+// Параметры синтетического города; при одинаковых параметрах город одинаковый
+// на любой платформе (свой генератор чисел вместо стандартных распределений)
+struct CitySettings {
+    uint32_t seed = 1;
+    size_t stops = 1000;
+    size_t buses = 100;
+    size_t min_route_stops = 5; // остановок в маршруте без обратного пути
+    size_t max_route_stops = 25;
+    double roundtrip_ratio = 0.5; // доля кольцевых маршрутов
+    double distance_density = 2.0; // дорожных расстояний до соседей на остановку, кроме маршрутных
+    size_t requests = 10000; // stat_requests
+    double miss_ratio = 0.02; // доля запросов Stop и Bus с несуществующими именами
+};
+
+struct Stop {
+    std::string name;
+    geo_coord::Coordinates coordinates;
+    std::vector<std::pair<std::string, int>> distances; // до остановки, метры
+};
+
+struct Bus {
+    std::string name;
+    bool is_roundtrip = false;
+    std::vector<std::string> stops; // как в base_requests: у кольцевого первая остановка и в конце
+};
+
+// запрос из stat_requests; для Stop и Bus в from имя, для Route from и to
+struct StatRequest {
+    std::string type;
+    std::string from;
+    std::string to;
+};
+
+struct City {
+    std::vector<Stop> stops;
+    std::vector<Bus> buses;
+    std::vector<StatRequest> requests;
+};
+
+// Остановки равномерно покрывают квадрат с шагом около 300 м, маршруты идут
+// к ближайшим остановкам по направлению движения, кольцевые поворачивают
+// и возвращаются к началу. Дорожное расстояние длиннее прямого в 1.1-1.6 раза
+City Generate(const CitySettings& settings);
+
+transport_router::RouterSettings MakeRouterSettings();
+map_renderer::RenderSettings MakeRenderSettings();
+
+// JSON для make_base и process_requests; db_path - файл из serialization_settings,
+// threads - потоков для чтения базы (0 - ключ не пишется, по числу ядер)
+void PrintBaseRequests(const City& city, const std::string& db_path, size_t threads, std::ostream& out);
+void PrintStatRequests(const City& city, const std::string& db_path, size_t threads, std::ostream& out);
+
+} // namespace city_generator
@@ -0,0 +1,74 @@
+#include "compression.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+namespace compression {
+
+std::string Gzip(std::string_view data) {
+    std::string result;
+
+    google::protobuf::io::StringOutputStream out_stream(&result);
+
+    google::protobuf::io::GzipOutputStream::Options options;
+    options.format = google::protobuf::io::GzipOutputStream::GZIP;
+    options.compression_level = 9;  // сжимаем один раз, а передаем много раз
+
+    google::protobuf::io::GzipOutputStream gzip_stream(&out_stream, options);
+
+    // данные передаются кодировщику кусками по размеру его буфера
+    while (!data.empty()) {
+        void* buffer = nullptr;
+        int size = 0;
+        if (!gzip_stream.Next(&buffer, &size)) {
+            break;
+        }
+
+        const size_t count = std::min(data.size(), static_cast<size_t>(size));
+        std::memcpy(buffer, data.data(), count);
+        gzip_stream.BackUp(size - static_cast<int>(count));
+        data.remove_prefix(count);
+    }
+    gzip_stream.Close();
+
+    return result;
+}
+
+std::string Base64Encode(std::string_view data) {
+    static constexpr char ALPHABET[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string result;
+    result.reserve((data.size() + 2) / 3 * 4);
+
+    size_t i = 0;
+    for (; i + 3 <= data.size(); i += 3) {
+        const uint32_t triple = (static_cast<uint8_t>(data[i]) << 16)
+                              | (static_cast<uint8_t>(data[i + 1]) << 8)
+                              | static_cast<uint8_t>(data[i + 2]);
+        result += ALPHABET[(triple >> 18) & 0x3F];
+        result += ALPHABET[(triple >> 12) & 0x3F];
+        result += ALPHABET[(triple >> 6) & 0x3F];
+        result += ALPHABET[triple & 0x3F];
+    }
+
+    // последние один или два байта дополняются '='
+    if (i < data.size()) {
+        uint32_t triple = static_cast<uint8_t>(data[i]) << 16;
+        if (i + 1 < data.size()) {
+            triple |= static_cast<uint8_t>(data[i + 1]) << 8;
+        }
+        result += ALPHABET[(triple >> 18) & 0x3F];
+        result += ALPHABET[(triple >> 12) & 0x3F];
+        result += (i + 1 < data.size()) ? ALPHABET[(triple >> 6) & 0x3F] : '=';
+        result += '=';
+    }
+
+    return result;
+}
+
+} // namespace compression
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace compression {
+
+// Сжимает данные в формате gzip потоковым кодировщиком zlib из protobuf
+std::string Gzip(std::string_view data);
+
+// Кодирует данные в base64 со стандартным алфавитом и дополнением '='
+std::string Base64Encode(std::string_view data);
+
+} // namespace compression
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory_resource>
 #include <vector>
 #include <string_view>
 
@@ -18,7 +19,7 @@ struct Bus {
     std::string_view name;
     const Stop* last_stop;
     bool is_roundtrip = false;
-    std::vector<const Stop*> stops;
+    std::pmr::vector<const Stop*> stops; // в арене каталога
 };
 
 } // namespace domain
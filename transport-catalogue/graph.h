@@ -1,5 +1,6 @@
 #pragma once
 
+#include "memory.h"
 #include "ranges.h"
 
 #include <cstdlib>
@@ -33,6 +34,9 @@ public:
     const Edge<Weight>& GetEdge(EdgeId edge_id) const;
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
 
+    // память в куче под ребра и списки смежности, байты
+    size_t MemoryUsage() const;
+
 private:
     std::vector<Edge<Weight>> edges_;
     std::vector<IncidenceList> incidence_lists_;
@@ -71,4 +75,13 @@ typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
 DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
     return ranges::AsRange(incidence_lists_.at(vertex));
 }
+
+template <typename Weight>
+size_t DirectedWeightedGraph<Weight>::MemoryUsage() const {
+    size_t bytes = memory::VectorBytes(edges_) + memory::VectorBytes(incidence_lists_);
+    for (const IncidenceList& list : incidence_lists_) {
+        bytes += memory::VectorBytes(list);
+    }
+    return bytes;
+}
 }  // namespace graph
\ No newline at end of file
@@ -1,5 +1,17 @@
 #include "json.h"
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <iterator>
+
+#include "memory.h"
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
+
 using namespace std::literals;
 
 namespace json {
@@ -92,8 +104,111 @@ const Node::Value& Node::GetValue() const {
     return *this;
 }
 
+size_t Node::MemoryUsage() const {
+    if (IsString()) {
+        return memory::StringBytes(AsString());
+    }
+    if (IsArray()) {
+        size_t bytes = memory::VectorBytes(AsArray());
+        for (const Node& node : AsArray()) {
+            bytes += node.MemoryUsage();
+        }
+        return bytes;
+    }
+    if (IsMap()) {
+        return AsMap().MemoryUsage();
+    }
+    return 0;
+}
+
 // <--- Node
 
+// ---> Dict
+
+namespace {
+
+bool KeyLess(const Dict::value_type& item, std::string_view key) {
+    return item.first < key;
+}
+
+bool ItemLess(const Dict::value_type& lhs, const Dict::value_type& rhs) {
+    return lhs.first < rhs.first;
+}
+
+bool ItemKeyEqual(const Dict::value_type& lhs, const Dict::value_type& rhs) {
+    return lhs.first == rhs.first;
+}
+
+} // namespace
+
+Dict::Dict(Storage items)
+    : items_(std::move(items)) {
+    if (!std::is_sorted(items_.begin(), items_.end(), ItemLess)) {
+        std::stable_sort(items_.begin(), items_.end(), ItemLess);
+    }
+    items_.erase(std::unique(items_.begin(), items_.end(), ItemKeyEqual), items_.end());
+}
+
+Dict::Dict(std::initializer_list<value_type> items)
+    : Dict(Storage(items)) {
+}
+
+Dict::iterator Dict::find(std::string_view key) {
+    auto it = std::lower_bound(items_.begin(), items_.end(), key, KeyLess);
+    return (it != items_.end() && it->first == key) ? it : items_.end();
+}
+
+Dict::const_iterator Dict::find(std::string_view key) const {
+    auto it = std::lower_bound(items_.begin(), items_.end(), key, KeyLess);
+    return (it != items_.end() && it->first == key) ? it : items_.end();
+}
+
+size_t Dict::count(std::string_view key) const {
+    return find(key) != end() ? 1 : 0;
+}
+
+Node& Dict::at(std::string_view key) {
+    auto it = find(key);
+    if (it == end()) {
+        throw std::out_of_range("key not found: "s + std::string(key));
+    }
+    return it->second;
+}
+
+const Node& Dict::at(std::string_view key) const {
+    auto it = find(key);
+    if (it == end()) {
+        throw std::out_of_range("key not found: "s + std::string(key));
+    }
+    return it->second;
+}
+
+std::pair<Dict::iterator, bool> Dict::emplace(std::string key, Node value) {
+    auto it = std::lower_bound(items_.begin(), items_.end(), key, KeyLess);
+    if (it != items_.end() && it->first == key) {
+        return {it, false};
+    }
+    return {items_.emplace(it, std::move(key), std::move(value)), true};
+}
+
+size_t Dict::MemoryUsage() const {
+    size_t bytes = memory::VectorBytes(items_);
+    for (const auto& [key, value] : items_) {
+        bytes += memory::StringBytes(key) + value.MemoryUsage();
+    }
+    return bytes;
+}
+
+bool operator==(const Dict& lhs, const Dict& rhs) {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+}
+
+bool operator!=(const Dict& lhs, const Dict& rhs) {
+    return !(lhs == rhs);
+}
+
+// <--- Dict
+
 
 bool operator==(const Node& lhs, const Node& rhs) {
     return lhs.GetValue() == rhs.GetValue();
@@ -105,33 +220,88 @@ bool operator!=(const Node& lhs, const Node& rhs) {
 
 namespace {
 
-Number LoadNumber(std::istream& input) {
-    std::string parsed_num;
+// -------------------------- разбор текста ----------------------------
+
+// Непрерывный буфер с текущей позицией разбора
+struct Input {
+    const char* pos;
+    const char* end;
+
+    // откуда берут память массивы и словари документа
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
+    // Общие для всех уровней вложенности стеки элементов: каждый массив
+    // и словарь копируется в собственный вектор один раз, точного размера
+    Array array_items = {};
+    Dict::Storage dict_items = {};
+
+    // Возвращает очередной символ или EOF, не сдвигая позицию
+    int Peek() const {
+        return pos == end ? EOF : static_cast<unsigned char>(*pos);
+    }
+
+    // Аналог input >> c: пропускает пробельные символы и считывает символ
+    bool Read(char& c) {
+        while (pos != end && std::isspace(static_cast<unsigned char>(*pos))) {
+            ++pos;
+        }
+        if (pos == end) {
+            return false;
+        }
+        c = *pos++;
+        return true;
+    }
+
+    void PutBack() {
+        --pos;
+    }
+};
 
-    // Считывает в parsed_num очередной символ из input
-    auto read_char = [&parsed_num, &input] {
-        parsed_num += static_cast<char>(input.get());
-        if (!input) {
-            throw ParsingError("Failed to read number from stream"s);
+// Ищет первый символ, прерывающий простое копирование строки: " \ \n \r
+const char* FindStringSpecial(const char* pos, const char* end) {
+#if defined(__SSE2__) && defined(__GNUC__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+
+    for (; end - pos >= 16; pos += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        const __m128i mask = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, cr)));
+        if (const int bits = _mm_movemask_epi8(mask); bits != 0) {
+            return pos + __builtin_ctz(bits);
         }
-    };
+    }
+#endif
+    for (; pos != end; ++pos) {
+        if (*pos == '"' || *pos == '\\' || *pos == '\n' || *pos == '\r') {
+            break;
+        }
+    }
+    return pos;
+}
+
+Number LoadNumber(Input& input) {
+    const char* const begin = input.pos;
 
-    // Считывает одну или более цифр в parsed_num из input
-    auto read_digits = [&input, read_char] {
-        if (!std::isdigit(input.peek())) {
+    // Пропускает одну или более цифр
+    auto read_digits = [&input] {
+        if (!std::isdigit(input.Peek())) {
             throw ParsingError("A digit is expected"s);
         }
-        while (std::isdigit(input.peek())) {
-            read_char();
+        while (std::isdigit(input.Peek())) {
+            ++input.pos;
         }
     };
 
-    if (input.peek() == '-') {
-        read_char();
+    if (input.Peek() == '-') {
+        ++input.pos;
     }
     // Парсим целую часть числа
-    if (input.peek() == '0') {
-        read_char();
+    if (input.Peek() == '0') {
+        ++input.pos;
         // После 0 в JSON не могут идти другие цифры
     } else {
         read_digits();
@@ -139,62 +309,64 @@ Number LoadNumber(std::istream& input) {
 
     bool is_int = true;
     // Парсим дробную часть числа
-    if (input.peek() == '.') {
-        read_char();
+    if (input.Peek() == '.') {
+        ++input.pos;
         read_digits();
         is_int = false;
     }
 
     // Парсим экспоненциальную часть числа
-    if (int ch = input.peek(); ch == 'e' || ch == 'E') {
-        read_char();
-        if (ch = input.peek(); ch == '+' || ch == '-') {
-            read_char();
+    if (int ch = input.Peek(); ch == 'e' || ch == 'E') {
+        ++input.pos;
+        if (ch = input.Peek(); ch == '+' || ch == '-') {
+            ++input.pos;
         }
         read_digits();
         is_int = false;
     }
 
-    try {
-        if (is_int) {
-            // Сначала пробуем преобразовать строку в int
-            try {
-                return std::stoi(parsed_num);
-            } catch (...) {
-                // В случае неудачи, например, при переполнении,
-                // код ниже попробует преобразовать строку в double
-            }
+    if (is_int) {
+        // Сначала пробуем преобразовать строку в int,
+        // при переполнении код ниже преобразует её в double
+        int value = 0;
+        if (auto [ptr, ec] = std::from_chars(begin, input.pos, value); ec == std::errc{} && ptr == input.pos) {
+            return value;
         }
-        return std::stod(parsed_num);
-    } catch (...) {
-        throw ParsingError("Failed to convert "s + parsed_num + " to number"s);
     }
+
+    double value = 0.0;
+    if (auto [ptr, ec] = std::from_chars(begin, input.pos, value); ec == std::errc{} && ptr == input.pos) {
+        return value;
+    }
+
+    throw ParsingError("Failed to convert "s + std::string(begin, input.pos) + " to number"s);
 }
 
 // Считывает содержимое строкового литерала JSON-документа
 // Функцию следует использовать после считывания открывающего символа ":
-std::string LoadString(std::istream& input) {
-    auto it = std::istreambuf_iterator<char>(input);
-    auto end = std::istreambuf_iterator<char>();
+std::string LoadString(Input& input) {
     std::string s;
     while (true) {
-        if (it == end) {
+        // Обычные символы копируем блоками до ближайшего особого символа
+        const char* special = FindStringSpecial(input.pos, input.end);
+        s.append(input.pos, special);
+        input.pos = special;
+
+        if (input.pos == input.end) {
             // Поток закончился до того, как встретили закрывающую кавычку?
             throw ParsingError("String parsing error");
         }
-        const char ch = *it;
+        const char ch = *input.pos++;
         if (ch == '"') {
             // Встретили закрывающую кавычку
-            ++it;
             break;
         } else if (ch == '\\') {
             // Встретили начало escape-последовательности
-            ++it;
-            if (it == end) {
+            if (input.pos == input.end) {
                 // Поток завершился сразу после символа обратной косой черты
                 throw ParsingError("String parsing error");
             }
-            const char escaped_char = *(it);
+            const char escaped_char = *input.pos++;
             // Обрабатываем одну из последовательностей: \\, \n, \t, \r, \"
             switch (escaped_char) {
                 case 'n':
@@ -216,39 +388,52 @@ std::string LoadString(std::istream& input) {
                     // Встретили неизвестную escape-последовательность
                     throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
             }
-        } else if (ch == '\n' || ch == '\r') {
+        } else {
             // Строковый литерал внутри- JSON не может прерываться символами \r или \n
             throw ParsingError("Unexpected end of line"s);
-        } else {
-            // Просто считываем очередной символ и помещаем его в результирующую строку
-            s.push_back(ch);
         }
-        ++it;
     }
 
     return s;
 }
 
-Node LoadNode(std::istream& input);
+// Считывает литерал null, true или false
+bool LoadLiteral(Input& input, std::string_view literal) {
+    if (static_cast<size_t>(input.end - input.pos) >= literal.size() &&
+        std::string_view(input.pos, literal.size()) == literal) {
+        input.pos += literal.size();
+        return true;
+    }
+    return false;
+}
+
+Node LoadNode(Input& input);
 
-Node LoadArray(std::istream& input) {
-    Array result;
+Node LoadArray(Input& input) {
+    const size_t first = input.array_items.size();
 
-    for (char c; input >> c && c != ']';) {
+    for (char c;;) {
+        if (!input.Read(c)) {
+            throw ParsingError("Failed to parse array node"s);
+        }
+        if (c == ']') {
+            break;
+        }
         if (c != ',') {
-            input.putback(c);
+            input.PutBack();
         }
-        result.push_back(LoadNode(input));
+        Node node = LoadNode(input);
+        input.array_items.push_back(std::move(node));
     }
 
-    if (!input) {
-        throw ParsingError("Failed to parse array node"s);
-    }
+    Array result(std::make_move_iterator(input.array_items.begin() + first),
+                 std::make_move_iterator(input.array_items.end()), input.resource);
+    input.array_items.resize(first);
 
     return Node(std::move(result));
 }
 
-Node LoadNum(std::istream& input) {
+Node LoadNum(Input& input) {
     auto num = LoadNumber(input);
     if (std::holds_alternative<double>(num)) {
         return Node(std::get<double>(num));
@@ -257,23 +442,27 @@ Node LoadNum(std::istream& input) {
     }
 }
 
-Node LoadStr(std::istream& input) {
+Node LoadStr(Input& input) {
     std::string line = LoadString(input);
 
     return Node(move(line));
 }
 
-Node LoadDict(std::istream& input) {
-    Dict dict;
+Node LoadDict(Input& input) {
+    const size_t first = input.dict_items.size();
 
-    for (char c; input >> c && c != '}';) {
+    for (char c;;) {
+        if (!input.Read(c)) {
+            throw ParsingError("Failed to parse dict node"s);
+        }
+        if (c == '}') {
+            break;
+        }
         if (c == '"') {
-            std::string key = LoadStr(input).AsString();
-            if (input >> c && c == ':') {
-                if (dict.find(key) != dict.end()) {
-                    throw ParsingError("Duplicate key '"s + key + "' has been found");
-                }
-                dict.emplace(std::move(key), LoadNode(input));
+            std::string key = LoadString(input);
+            if (input.Read(c) && c == ':') {
+                Node node = LoadNode(input);
+                input.dict_items.emplace_back(std::move(key), std::move(node));
             }
             else {
                 throw ParsingError(": is expected but '"s + c + "' has been found"s);
@@ -283,58 +472,42 @@ Node LoadDict(std::istream& input) {
             throw ParsingError(R"(',' is expected but ')"s + c + "' has been found"s);
         }
     }
-    if (!input) {
-        throw ParsingError("Failed to parse dict node"s);
-    }
-    return Node(std::move(dict));
-}
-
-Node LoadNull(std::istream& input) {
-    std::string res;
 
-    char c;
+    Dict::Storage items(std::make_move_iterator(input.dict_items.begin() + first),
+                        std::make_move_iterator(input.dict_items.end()), input.resource);
+    input.dict_items.resize(first);
 
-    for (int i = 0; i < 4; ++i) {
-        if(input.get(c)) {
-            res+=c;
-        }
+    std::sort(items.begin(), items.end(), ItemLess);
+    if (auto it = std::adjacent_find(items.begin(), items.end(), ItemKeyEqual); it != items.end()) {
+        throw ParsingError("Duplicate key '"s + it->first + "' has been found");
     }
 
-    if (res != "null") {
+    return Node(Dict(std::move(items)));
+}
+
+Node LoadNull(Input& input) {
+    if (!LoadLiteral(input, "null"sv)) {
         throw ParsingError("Failed to parse null node");
     }
 
     return Node();
 }
 
-Node LoadBool(std::istream& input) {
-    std::string res;
-    char c;
-
-    //определяю сколько символов считывать
-    c = static_cast<char>(input.peek());
-    int length = c == 't' ? 4 : 5;
-
-    for (int i = 0; i < length; ++i) {
-        if(input.get(c)) {
-            res+=c;
-        }
-    }
-
-    if (res != "true"s && res != "false"s) {
-        throw ParsingError("Failed to parse bool node");
-    }
-
-    if (res == "true") {
+Node LoadBool(Input& input) {
+    if (LoadLiteral(input, "true"sv)) {
         return Node(true);
-    } else {
+    } else if (LoadLiteral(input, "false"sv)) {
         return Node(false);
     }
+
+    throw ParsingError("Failed to parse bool node");
 }
 
-Node LoadNode(std::istream& input) {
+Node LoadNode(Input& input) {
     char c;
-    input >> c;
+    if (!input.Read(c)) {
+        throw ParsingError("Unexpected end of input"s);
+    }
 
     if (c == '[') {
         return LoadArray(input);
@@ -343,20 +516,103 @@ Node LoadNode(std::istream& input) {
     } else if (c == '"') {
         return LoadStr(input);
     } else if (c == 't') { // true
-        input.putback(c);
+        input.PutBack();
         return LoadBool(input);
     } else if (c == 'f') { // false
-        input.putback(c);
+        input.PutBack();
         return LoadBool(input);
     } else if (c == 'n') { // null
-        input.putback(c);
+        input.PutBack();
         return LoadNull(input);
     } else {
-        input.putback(c);
+        input.PutBack();
         return LoadNum(input);
     }
 }
 
+// -------------------------- потоковый разбор ----------------------------
+
+void ParseNode(Input& input, Handler& handler);
+
+void ParseArray(Input& input, Handler& handler) {
+    handler.StartArray();
+
+    for (char c;;) {
+        if (!input.Read(c)) {
+            throw ParsingError("Failed to parse array node"s);
+        }
+        if (c == ']') {
+            break;
+        }
+        if (c != ',') {
+            input.PutBack();
+        }
+        ParseNode(input, handler);
+    }
+
+    handler.EndArray();
+}
+
+void ParseDict(Input& input, Handler& handler) {
+    handler.StartDict();
+
+    for (char c;;) {
+        if (!input.Read(c)) {
+            throw ParsingError("Failed to parse dict node"s);
+        }
+        if (c == '}') {
+            break;
+        }
+        if (c == '"') {
+            std::string key = LoadString(input);
+            if (input.Read(c) && c == ':') {
+                handler.Key(std::move(key));
+                ParseNode(input, handler);
+            }
+            else {
+                throw ParsingError(": is expected but '"s + c + "' has been found"s);
+            }
+        }
+        else if (c != ',') {
+            throw ParsingError(R"(',' is expected but ')"s + c + "' has been found"s);
+        }
+    }
+
+    handler.EndDict();
+}
+
+void ParseNode(Input& input, Handler& handler) {
+    char c;
+    if (!input.Read(c)) {
+        throw ParsingError("Unexpected end of input"s);
+    }
+
+    if (c == '[') {
+        ParseArray(input, handler);
+    } else if (c == '{') {
+        ParseDict(input, handler);
+    } else if (c == '"') {
+        handler.Value(LoadString(input));
+    } else {
+        // скаляры разбираем так же, как при построении документа
+        input.PutBack();
+        Node node = LoadNode(input);
+        handler.Value(std::move(node.GetValue()));
+    }
+}
+
+// Считывает поток целиком в непрерывный буфер
+std::string ReadAll(std::istream& input) {
+    std::string buffer;
+    char chunk[1 << 16];
+
+    while (input.read(chunk, sizeof(chunk)) || input.gcount() > 0) {
+        buffer.append(chunk, static_cast<size_t>(input.gcount()));
+    }
+
+    return buffer;
+}
+
 } // namespace
 
 Document::Document(Node root)
@@ -367,6 +623,10 @@ const Node& Document::GetRoot() const {
     return root_;
 }
 
+size_t Document::MemoryUsage() const {
+    return root_.MemoryUsage();
+}
+
 bool operator==(const Document& lhs, const Document& rhs) {
     return lhs.GetRoot() == rhs.GetRoot();
 }
@@ -375,40 +635,29 @@ bool operator!=(const Document& lhs, const Document& rhs) {
     return !(lhs == rhs);
 }
 
-Document Load(std::istream& input) {
+Document Load(std::string_view text, std::pmr::memory_resource* resource) {
+    Input input{text.data(), text.data() + text.size(), resource};
     return Document{LoadNode(input)};
 }
 
-namespace {
-
-// -------------------------- печать нод ----------------------------
-
-// Контекст вывода, хранит ссылку на поток вывода и текущий отсуп
-struct PrintContext {
-    std::ostream& out;
-    int indent_step = 4;
-    int indent = 0;
+Document Load(std::istream& input, std::pmr::memory_resource* resource) {
+    return Load(ReadAll(input), resource);
+}
 
-    void PrintIndent() const {
-        for (int i = 0; i < indent; ++i) {
-            out.put(' ');
-        }
-    }
+void Parse(std::string_view text, Handler& handler) {
+    Input input{text.data(), text.data() + text.size()};
+    ParseNode(input, handler);
+}
 
-    // Возвращает новый контекст вывода с увеличенным смещением
-    PrintContext Indented() const {
-        return {out, indent_step, indent_step + indent};
-    }
-};
+void Parse(std::istream& input, Handler& handler) {
+    Parse(ReadAll(input), handler);
+}
 
-void PrintNode(const Node &node, const PrintContext& ctx);
+// ---> Writer
 
-template <typename Value>
-void PrintValue(const Value& value, const PrintContext& ctx) {
-    ctx.out << value;
-}
+namespace {
 
-void PrintString(const std::string& value, std::ostream& out) {
+void PrintString(std::string_view value, std::ostream& out) {
     out.put('"');
     for (const char c : value) {
         switch (c) {
@@ -432,73 +681,174 @@ void PrintString(const std::string& value, std::ostream& out) {
     out.put('"');
 }
 
-template <>
-void PrintValue<std::string>(const std::string& value, const PrintContext& ctx) {
-    PrintString(value, ctx.out);
+} // namespace
+
+Writer::Writer(std::ostream& out, bool indented)
+    : out_(out)
+    , indented_(indented) {
+}
+
+Writer& Writer::StartDict() {
+    BeginValue();
+    out_.put('{');
+    first_.push_back(true);
+    return *this;
 }
 
-template <>
-void PrintValue<std::nullptr_t>(const std::nullptr_t&, const PrintContext& ctx) {
-    ctx.out << "null"sv;
+Writer& Writer::EndDict() {
+    EndContainer('}');
+    return *this;
 }
 
-template <>
-void PrintValue<bool>(const bool& value, const PrintContext& ctx) {
-    ctx.out << (value ? "true"sv : "false"sv);
+Writer& Writer::StartArray() {
+    BeginValue();
+    out_.put('[');
+    first_.push_back(true);
+    return *this;
 }
 
-template <>
-void PrintValue<Array>(const Array& nodes, const PrintContext& ctx) {
-    std::ostream& out = ctx.out;
-    out << "[\n"sv;
-    bool first = true;
-    auto inner_ctx = ctx.Indented();
-    for (const Node& node : nodes) {
-        if (first) {
-            first = false;
-        }
-        else {
-            out << ",\n"sv;
+Writer& Writer::EndArray() {
+    EndContainer(']');
+    return *this;
+}
+
+Writer& Writer::Key(std::string_view key) {
+    BeginValue();
+    PrintString(key, out_);
+    out_ << (indented_ ? ": "sv : ":"sv);
+    after_key_ = true;
+    return *this;
+}
+
+Writer& Writer::Value(std::nullptr_t) {
+    BeginValue();
+    out_ << "null"sv;
+    return *this;
+}
+
+Writer& Writer::Value(bool value) {
+    BeginValue();
+    out_ << (value ? "true"sv : "false"sv);
+    return *this;
+}
+
+Writer& Writer::Value(int value) {
+    BeginValue();
+    char buffer[16];
+    auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value);
+    out_.write(buffer, ptr - buffer);
+    return *this;
+}
+
+Writer& Writer::Value(uint64_t value) {
+    BeginValue();
+    char buffer[24];
+    auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value);
+    out_.write(buffer, ptr - buffer);
+    return *this;
+}
+
+Writer& Writer::Value(double value) {
+    BeginValue();
+    // как operator<< по умолчанию: 6 значащих цифр, формат %g
+    char buffer[32];
+    auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value, std::chars_format::general, 6);
+    out_.write(buffer, ptr - buffer);
+    return *this;
+}
+
+Writer& Writer::Value(std::string_view value) {
+    BeginValue();
+    PrintString(value, out_);
+    return *this;
+}
+
+Writer& Writer::Value(const std::string& value) {
+    return Value(std::string_view(value));
+}
+
+Writer& Writer::Value(const char* value) {
+    return Value(std::string_view(value));
+}
+
+Writer& Writer::Value(const Node& node) {
+    if (node.IsArray()) {
+        StartArray();
+        for (const Node& item : node.AsArray()) {
+            Value(item);
         }
-        inner_ctx.PrintIndent();
-        PrintNode(node, inner_ctx);
-    }
-    out.put('\n');
-    ctx.PrintIndent();
-    out.put(']');
-}
-
-template <>
-void PrintValue<Dict>(const Dict& nodes, const PrintContext& ctx) {
-    std::ostream& out = ctx.out;
-    out << "{\n"sv;
-    bool first = true;
-    auto inner_ctx = ctx.Indented();
-    for (const auto& [key, node] : nodes) {
-        if (first) {
-            first = false;
+        EndArray();
+    } else if (node.IsMap()) {
+        StartDict();
+        for (const auto& [key, item] : node.AsMap()) {
+            Key(key);
+            Value(item);
         }
-        else {
-            out << ",\n"sv;
+        EndDict();
+    } else {
+        std::visit([this](const auto& value) {
+            using T = std::decay_t<decltype(value)>;
+            if constexpr (!std::is_same_v<T, Array> && !std::is_same_v<T, Dict>) {
+                Value(value);
+            }
+        }, node.GetValue());
+    }
+    return *this;
+}
+
+Writer& Writer::RawValue(std::string_view json) {
+    BeginValue();
+    out_.write(json.data(), json.size());
+    return *this;
+}
+
+bool Writer::IsIndented() const {
+    return indented_;
+}
+
+void Writer::BeginValue() {
+    if (after_key_) {
+        // значение идет сразу за ключом
+        after_key_ = false;
+        return;
+    }
+    if (first_.empty()) {
+        return;
+    }
+    if (!first_.back()) {
+        out_.put(',');
+    }
+    first_.back() = false;
+    if (indented_) {
+        out_.put('\n');
+        Indent(first_.size());
+    }
+}
+
+void Writer::EndContainer(char bracket) {
+    const bool empty = first_.back();
+    first_.pop_back();
+    if (indented_) {
+        // пустой контейнер печатается с пустой строкой внутри, как и раньше
+        if (empty) {
+            out_.put('\n');
         }
-        inner_ctx.PrintIndent();
-        PrintString(key, ctx.out);
-        out << ": "sv;
-        PrintNode(node, inner_ctx);
+        out_.put('\n');
+        Indent(first_.size());
     }
-    out.put('\n');
-    ctx.PrintIndent();
-    out.put('}');
+    out_.put(bracket);
 }
 
-void PrintNode(const Node& node, const PrintContext& ctx) {
-    std::visit([&ctx](const auto& value){PrintValue(value, ctx);}, node.GetValue());
+void Writer::Indent(size_t depth) {
+    for (size_t i = 0; i < depth; ++i) {
+        out_ << "    "sv;
+    }
 }
 
-} // namespace
+// <--- Writer
 
 void Print(const Document& doc, std::ostream& output) {
-    PrintNode(doc.GetRoot(), PrintContext{ output });
+    Writer(output).Value(doc.GetRoot());
 }
 
 } // namespace json
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <cstdint>
+#include <initializer_list>
 #include <istream>
-#include <map>
+#include <memory_resource>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <variant>
@@ -11,10 +15,50 @@
 namespace json {
 
 class Node;
-using Array = std::vector<Node>;
-using Dict = std::map<std::string, Node>;
+// Массивы и словари документа берут память из std::pmr::memory_resource,
+// при разборе - из переданного в Load, иначе - из ресурса по умолчанию
+using Array = std::pmr::vector<Node>;
 using Number = std::variant<int, double>;
 
+// Словарь хранится плоским вектором пар, отсортированным по ключу,
+// поиск идет по std::string_view без создания временных строк
+class Dict {
+public:
+    using value_type = std::pair<std::string, Node>;
+    using Storage = std::pmr::vector<value_type>;
+    using iterator = Storage::iterator;
+    using const_iterator = Storage::const_iterator;
+
+    Dict() = default;
+    // элементы сортируются, из повторяющихся ключей остается первый
+    explicit Dict(Storage items);
+    Dict(std::initializer_list<value_type> items);
+
+    size_t size() const;
+    bool empty() const;
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    iterator find(std::string_view key);
+    const_iterator find(std::string_view key) const;
+    size_t count(std::string_view key) const;
+
+    Node& at(std::string_view key);
+    const Node& at(std::string_view key) const;
+
+    // как у std::map: существующий ключ не перезаписывается
+    std::pair<iterator, bool> emplace(std::string key, Node value);
+
+    // память в куче под элементы и вложенные значения, байты
+    size_t MemoryUsage() const;
+
+private:
+    Storage items_;
+};
+
 class ParsingError : public std::runtime_error {
 public:
     //! делаем доступными все конструкторы родительского класса
@@ -48,11 +92,41 @@ public:
 
     Value& GetValue();
     const Value& GetValue() const;
+
+    // память в куче под строки и вложенные контейнеры, байты
+    size_t MemoryUsage() const;
 };
 
 bool operator==(const Node& lhs, const Node& rhs);
 bool operator!=(const Node& lhs, const Node& rhs);
 
+bool operator==(const Dict& lhs, const Dict& rhs);
+bool operator!=(const Dict& lhs, const Dict& rhs);
+
+inline size_t Dict::size() const {
+    return items_.size();
+}
+
+inline bool Dict::empty() const {
+    return items_.empty();
+}
+
+inline Dict::iterator Dict::begin() {
+    return items_.begin();
+}
+
+inline Dict::iterator Dict::end() {
+    return items_.end();
+}
+
+inline Dict::const_iterator Dict::begin() const {
+    return items_.begin();
+}
+
+inline Dict::const_iterator Dict::end() const {
+    return items_.end();
+}
+
 class Document {
 public:
     Document() = default;
@@ -60,6 +134,9 @@ public:
 
     const Node& GetRoot() const;
 
+    // память в куче под все дерево, байты
+    size_t MemoryUsage() const;
+
 private:
     Node root_;
 };
@@ -67,7 +144,65 @@ private:
 bool operator==(const Document& lhs, const Document& rhs);
 bool operator!=(const Document& lhs, const Document& rhs);
 
-Document Load(std::istream& input);
+// Поток считывается целиком в буфер, разбор идет по буферу. Массивы и словари
+// размещаются в resource (например, в арене), документ не должен его пережить
+Document Load(std::istream& input, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+Document Load(std::string_view text, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+// Обработчик событий потокового (SAX) разбора JSON
+class Handler {
+public:
+    virtual void StartDict() = 0;
+    virtual void EndDict() = 0;
+    virtual void StartArray() = 0;
+    virtual void EndArray() = 0;
+    virtual void Key(std::string key) = 0;
+    virtual void Value(Node::Value value) = 0;
+
+    virtual ~Handler() = default;
+};
+
+// Разбирает поток, передавая события обработчику без построения документа
+void Parse(std::istream& input, Handler& handler);
+void Parse(std::string_view text, Handler& handler);
+
+// Потоковая запись JSON: значения сразу выводятся в поток, документ не строится.
+// С отступами вывод совпадает с json::Print, без них получается компактная запись
+class Writer {
+public:
+    explicit Writer(std::ostream& output, bool indented = true);
+
+    Writer& StartDict();
+    Writer& EndDict();
+    Writer& StartArray();
+    Writer& EndArray();
+    Writer& Key(std::string_view key);
+
+    Writer& Value(std::nullptr_t);
+    Writer& Value(bool value);
+    Writer& Value(int value);
+    Writer& Value(uint64_t value);
+    Writer& Value(double value);
+    Writer& Value(std::string_view value);
+    Writer& Value(const std::string& value);
+    Writer& Value(const char* value);
+    Writer& Value(const Node& node);
+
+    // Выводит заранее сериализованное значение как есть
+    Writer& RawValue(std::string_view json);
+
+    bool IsIndented() const;
+
+private:
+    std::ostream& out_;
+    bool indented_;
+    std::vector<bool> first_; // для открытых контейнеров: элементов еще не было
+    bool after_key_ = false;
+
+    void BeginValue();
+    void EndContainer(char bracket);
+    void Indent(size_t depth);
+};
 
 void Print(const Document& doc, std::ostream& output);
 
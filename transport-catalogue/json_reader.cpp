@@ -1,8 +1,16 @@
 #include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
 #include <sstream>
 
+#include "compression.h"
 #include "json_reader.h"
 #include "json_builder.h"
+#include "metrics.h"
+#include "trace.h"
 
 namespace json_reader {
 
@@ -16,39 +24,18 @@ std::string space_trimmer(const std::string& name) {
     return name.substr(from, to);
 }
 
-StopQuery QueryStop(const json::Dict& dict) {
-    StopQuery stop;
-
-    stop.type = query_type::STOP;
-    stop.name = space_trimmer(dict.at("name"s).AsString());
-    stop.coordinates.lat = dict.at("latitude"s).AsDouble();
-    stop.coordinates.lng = dict.at("longitude"s).AsDouble();
-
-    const json::Dict & ref_to_dict = dict.at("road_distances"s).AsMap();
-
-    stop.distances.reserve(ref_to_dict.size());
-    for (const auto& [name, node] : ref_to_dict) {
-        stop.distances.emplace_back(make_pair(node.AsInt(), name));
-    }
-
-    return stop;
-}
-
-BusQuery QueryBus(const json::Dict& dict) {
+BusQuery QueryBus(BaseRequest&& request) {
     BusQuery bus;
 
     bus.type = query_type::BUS;
-    bus.name = space_trimmer(dict.at("name"s).AsString());
+    bus.name = space_trimmer(request.name);
 
-    bus.is_roundtrip = dict.at("is_roundtrip"s).AsBool();
+    bus.is_roundtrip = request.is_roundtrip;
 
-    const json::Array& ref_to_array = dict.at("stops"s).AsArray();
+    bus.stops = std::move(request.stops);
 
     // резервируем место
-    bus.stops.reserve(bus.is_roundtrip ? ref_to_array.size() : 2*ref_to_array.size());
-    for (const auto& name : ref_to_array) {
-        bus.stops.emplace_back(name.AsString());
-    }
+    bus.stops.reserve(bus.is_roundtrip ? bus.stops.size() : 2*bus.stops.size());
 
     // имя конечной остановки
     bus.name_last_stop = bus.stops.back();
@@ -78,20 +65,48 @@ StatQuery QueryStat(const json::Dict& dict) {
     StatQuery stat;
 
     // общее поле
-    stat.id = dict.at("id"s).AsInt();
+    stat.id = dict.at("id"sv).AsInt();
 
-    if (!dict.at("type"s).AsString().compare("Stop"s)) {
+    if (!dict.at("type"sv).AsString().compare("Stop"s)) {
         stat.type = query_type::STOP;
-        stat.name = space_trimmer(dict.at("name"s).AsString());
-    } else if (!dict.at("type"s).AsString().compare("Bus"s)) {
+        stat.name = space_trimmer(dict.at("name"sv).AsString());
+    } else if (!dict.at("type"sv).AsString().compare("Bus"s)) {
         stat.type = query_type::BUS;
-        stat.name = space_trimmer(dict.at("name"s).AsString());
-    } else if (!dict.at("type"s).AsString().compare("Map"s)) {
+        stat.name = space_trimmer(dict.at("name"sv).AsString());
+    } else if (!dict.at("type"sv).AsString().compare("Map"s)) {
         stat.type = query_type::MAP;
-    } else if (!dict.at("type"s).AsString().compare("Route"s)) {
+
+        if (dict.count("bbox"sv)) {
+            // [широта, долгота, широта, долгота] двух противоположных углов
+            const json::Array& bbox = dict.at("bbox"sv).AsArray();
+            if (bbox.size() != 4) {
+                throw std::invalid_argument("bbox must have 4 numbers"s);
+            }
+            map_renderer::Viewport viewport;
+            viewport.min = {std::min(bbox.at(0).AsDouble(), bbox.at(2).AsDouble()),
+                            std::min(bbox.at(1).AsDouble(), bbox.at(3).AsDouble())};
+            viewport.max = {std::max(bbox.at(0).AsDouble(), bbox.at(2).AsDouble()),
+                            std::max(bbox.at(1).AsDouble(), bbox.at(3).AsDouble())};
+            stat.bbox = viewport;
+        } else if (dict.count("tile"sv)) {
+            const json::Dict& tile = dict.at("tile"sv).AsMap();
+            stat.tile = MapTile{tile.at("z"sv).AsInt(), tile.at("x"sv).AsInt(), tile.at("y"sv).AsInt()};
+        }
+
+        if (dict.count("compression"sv)) {
+            const std::string& compression = dict.at("compression"sv).AsString();
+            if (compression == "gzip"s) {
+                stat.compressed = true;
+            } else if (compression != "none"s) {
+                throw std::invalid_argument("unknown map compression: "s + compression);
+            }
+        }
+    } else if (!dict.at("type"sv).AsString().compare("Route"s)) {
         stat.type = query_type::ROUTE;
-        stat.from = space_trimmer(dict.at("from"s).AsString());
-        stat.to = space_trimmer(dict.at("to"s).AsString());
+        stat.from = space_trimmer(dict.at("from"sv).AsString());
+        stat.to = space_trimmer(dict.at("to"sv).AsString());
+    } else if (!dict.at("type"sv).AsString().compare("Stats"s)) {
+        stat.type = query_type::STATS;
     }
 
     return stat;
@@ -99,50 +114,176 @@ StatQuery QueryStat(const json::Dict& dict) {
 
 } // namespace details
 
+// Разбирает make_base запросы по мере чтения потока: остановки сразу попадают
+// в каталог, маршруты откладываются до Parse(), а небольшие разделы
+// настроек собираются в json::Node и передаются в Load* функции
+class JsonReader::BaseHandler final : public json::Handler {
+public:
+    explicit BaseHandler(JsonReader& reader) : reader_(reader) {
+    }
+
+    void StartDict() override {
+        if (builder_) {
+            builder_->StartDict();
+        } else if (1 == depth_ && section_ != "base_requests"s) {
+            // раздел настроек
+            builder_.emplace();
+            builder_->StartDict();
+        } else if (2 == depth_) {
+            // очередной запрос
+            request_ = {};
+        }
+        ++depth_;
+    }
+
+    void EndDict() override {
+        --depth_;
+        if (builder_) {
+            builder_->EndDict();
+            if (1 == depth_) {
+                LoadSection();
+            }
+        } else if (2 == depth_) {
+            reader_.AddBaseRequest(std::move(request_));
+        }
+    }
+
+    void StartArray() override {
+        if (builder_) {
+            builder_->StartArray();
+        } else if (1 == depth_ && section_ != "base_requests"s) {
+            builder_.emplace();
+            builder_->StartArray();
+        }
+        ++depth_;
+    }
+
+    void EndArray() override {
+        --depth_;
+        if (builder_) {
+            builder_->EndArray();
+            if (1 == depth_) {
+                LoadSection();
+            }
+        }
+    }
+
+    void Key(std::string key) override {
+        if (builder_) {
+            builder_->Key(std::move(key));
+        } else if (1 == depth_) {
+            section_ = std::move(key);
+        } else if (3 == depth_) {
+            field_ = std::move(key);
+        } else if (4 == depth_) {
+            key_ = std::move(key);
+        }
+    }
+
+    void Value(json::Node::Value value) override {
+        if (builder_) {
+            builder_->Value(std::move(value));
+            return;
+        }
+
+        json::Node node(value);
+
+        if (3 == depth_) {
+            // поле запроса
+            if (field_ == "type"s) {
+                request_.type = node.AsString();
+            } else if (field_ == "name"s) {
+                request_.name = node.AsString();
+            } else if (field_ == "latitude"s) {
+                request_.coordinates.lat = node.AsDouble();
+            } else if (field_ == "longitude"s) {
+                request_.coordinates.lng = node.AsDouble();
+            } else if (field_ == "is_roundtrip"s) {
+                request_.is_roundtrip = node.AsBool();
+            }
+        } else if (4 == depth_) {
+            // элемент вложенного словаря или массива
+            if (field_ == "road_distances"s) {
+                request_.distances.emplace_back(node.AsInt(), std::move(key_));
+            } else if (field_ == "stops"s) {
+                request_.stops.emplace_back(node.AsString());
+            }
+        }
+    }
+
+private:
+    JsonReader& reader_;
+
+    int depth_ = 0;          // число открытых словарей и массивов
+    std::string section_;    // ключ верхнего уровня
+    std::string field_;      // поле текущего запроса
+    std::string key_;        // ключ во вложенном словаре запроса
+    details::BaseRequest request_;
+
+    std::optional<json::Builder> builder_;
+
+    void LoadSection() {
+        json::Node node = builder_->Build();
+        builder_.reset();
+
+        if (!section_.compare("render_settings"s)) {
+            reader_.LoadRender(node.AsMap());
+        } else if (!section_.compare("routing_settings"s)) {
+            reader_.LoadRouting(node.AsMap());
+        } else if (!section_.compare("serialization_settings"s)) {
+            reader_.LoadSerialization(node.AsMap());
+        }
+    }
+};
+
 JsonReader::JsonReader(transport_catalogue::TransportCatalogue& catalogue,
                        map_renderer::MapRenderer& renderer,
                        transport_router::TransportRouter& router,
-                       serialization::Serializator& serializator) :
+                       serialization::Serializator& serializator,
+                       response_cache::ResponseCache& responses) :
                        catalogue_(catalogue), renderer_(renderer),
-                       router_(router), serializator_(serializator) {
+                       router_(router), serializator_(serializator),
+                       responses_(responses) {
 
 }
 
 void JsonReader::GeneralLoadBase(std::istream& input) {
-    json::Document document = json::Load(input);
+    trace::Scope scope("LoadBase");
 
-    size_t total_size = 0;
+    BaseHandler handler(*this);
 
-    // запрашиваем размеры
-    for (const auto& [name, node] : document.GetRoot().AsMap()) {
-        if (!name.compare("base_requests"s)) {
-            total_size += node.AsArray().size();
-        } else if (!name.compare("render_settings"s)) {
-            total_size += node.AsMap().size();
-        } else if (!name.compare("routing_settings"s)) {
-            total_size += node.AsMap().size();
-        }
-    }
+    // разбираем поток без построения документа
+    json::Parse(input, handler);
+}
 
-    // резервируем место
-    queries_.reserve(total_size);
+void JsonReader::AddBaseRequest(details::BaseRequest&& request) {
+    if (!request.type.compare("Stop"s)) {
+        // остановка
+        std::string name = details::space_trimmer(request.name);
 
-    // загружаем данные
-    for (const auto& [name, node] : document.GetRoot().AsMap()) {
-        if (!name.compare("base_requests"s)) {
-            LoadBase(node.AsArray());
-        } else if (!name.compare("render_settings"s)) {
-            LoadRender(node.AsMap());
-        } else if (!name.compare("routing_settings"s)) {
-            LoadRouting(node.AsMap());
-        } else if (!name.compare("serialization_settings"s)) {
-            LoadSerialization(node.AsMap());
+        // добавляем в каталог остановки
+        catalogue_.addStop(name, request.coordinates);
+
+        // запоминаем расстояния для остановки (для сериализации)
+        if (!request.distances.empty()) {
+            catalogue_.addStopDistance(name, request.distances);
         }
+    } else if (!request.type.compare("Bus"s)) {
+        // маршрут
+        bus_queries_.emplace_back(details::QueryBus(std::move(request)));
     }
 }
 
-void JsonReader::GeneralLoadRequests(std::istream& input) {
-    json::Document document = json::Load(input);
+bool JsonReader::GeneralLoadRequests(std::istream& input) {
+    trace::Scope scope("LoadRequests");
+
+    // документ нужен только до конца загрузки: его массивы и словари лежат
+    // в арене и освобождаются разом вместе с ней
+    std::pmr::monotonic_buffer_resource arena;
+    json::Document document = [&input, &arena] {
+        trace::Scope scope("ParseJson");
+        return json::Load(input, &arena);
+    }();
 
     size_t total_size = 0;
 
@@ -157,6 +298,8 @@ void JsonReader::GeneralLoadRequests(std::istream& input) {
     // резервируем место
     queries_.reserve(total_size);
 
+    document_bytes_ = document.MemoryUsage();
+
     // загружаем данные
     for (const auto& [name, node] : document.GetRoot().AsMap()) {
         if (!name.compare("stat_requests"s)) {
@@ -167,42 +310,29 @@ void JsonReader::GeneralLoadRequests(std::istream& input) {
     }
 
     // десериализация данных каталога
-    serializator_.Deserialize();
-}
-
-void JsonReader::LoadBase(const json::Array& vct) {
-    for (const auto& it : vct) {
-        if (0 == it.AsMap().count("type"s)) {
-            continue;
-        }
-
-        if (!it.AsMap().at("type"s).AsString().compare("Stop"s)) {
-            // остановка
-            queries_.emplace_back(std::make_unique<details::StopQuery>(details::QueryStop(it.AsMap())));
-        } else if (!it.AsMap().at("type"s).AsString().compare("Bus"s)) {
-            // маршрут
-            queries_.emplace_back(std::make_unique<details::BusQuery>(details::QueryBus(it.AsMap())));
-        }
-    }
+    return serializator_.Deserialize();
 }
 
 void JsonReader::LoadStat(const json::Array& vct) {
     for (const auto& it : vct) {
-        if (0 == it.AsMap().count("type"s)) {
+        if (0 == it.AsMap().count("type"sv)) {
             continue;
         }
-        if (!it.AsMap().at("type"s).AsString().compare("Stop"s)) {
+        if (!it.AsMap().at("type"sv).AsString().compare("Stop"s)) {
             // остановка
             queries_.emplace_back(std::make_unique<details::StatQuery>(details::QueryStat(it.AsMap())));
-        } else if (!it.AsMap().at("type"s).AsString().compare("Bus"s)) {
+        } else if (!it.AsMap().at("type"sv).AsString().compare("Bus"s)) {
             // маршрут
             queries_.emplace_back(std::make_unique<details::StatQuery>(details::QueryStat(it.AsMap())));
-        } else if (!it.AsMap().at("type"s).AsString().compare("Map"s)) {
+        } else if (!it.AsMap().at("type"sv).AsString().compare("Map"s)) {
             // карта
             queries_.emplace_back(std::make_unique<details::StatQuery>(details::QueryStat(it.AsMap())));
-        } else if (!it.AsMap().at("type"s).AsString().compare("Route"s)) {
+        } else if (!it.AsMap().at("type"sv).AsString().compare("Route"s)) {
             // построение маршрута
             queries_.emplace_back(std::make_unique<details::StatQuery>(details::QueryStat(it.AsMap())));
+        } else if (!it.AsMap().at("type"sv).AsString().compare("Stats"s)) {
+            // метрики процесса
+            queries_.emplace_back(std::make_unique<details::StatQuery>(details::QueryStat(it.AsMap())));
         }
     }
 }
@@ -235,35 +365,55 @@ svg::Color JsonReader::LoadColor(const json::Node& node) {
 void JsonReader::LoadRender(const json::Dict& dict) {
     map_renderer::RenderSettings settings;
 
-    settings.width = dict.at("width"s).AsDouble();
-    settings.height = dict.at("height"s).AsDouble();
-    settings.padding = dict.at("padding"s).AsDouble();
-    settings.line_width = dict.at("line_width"s).AsDouble();
-    settings.stop_radius = dict.at("stop_radius"s).AsDouble();
-    settings.bus_label_font_size = dict.at("bus_label_font_size"s).AsInt();
-    settings.bus_label_offset[0] = dict.at("bus_label_offset"s).AsArray()[0].AsDouble();
-    settings.bus_label_offset[1] = dict.at("bus_label_offset"s).AsArray()[1].AsDouble();
-    settings.stop_label_font_size = dict.at("stop_label_font_size"s).AsInt();
-    settings.stop_label_offset[0] = dict.at("stop_label_offset"s).AsArray()[0].AsDouble();
-    settings.stop_label_offset[1] = dict.at("stop_label_offset"s).AsArray()[1].AsDouble();
-    settings.underlayer_color = LoadColor(dict.at("underlayer_color"s));
-    settings.underlayer_width = dict.at("underlayer_width"s).AsDouble();
-
-    const json::Array& array = dict.at("color_palette"s).AsArray();
+    settings.width = dict.at("width"sv).AsDouble();
+    settings.height = dict.at("height"sv).AsDouble();
+    settings.padding = dict.at("padding"sv).AsDouble();
+    settings.line_width = dict.at("line_width"sv).AsDouble();
+    settings.stop_radius = dict.at("stop_radius"sv).AsDouble();
+    settings.bus_label_font_size = dict.at("bus_label_font_size"sv).AsInt();
+    settings.bus_label_offset[0] = dict.at("bus_label_offset"sv).AsArray()[0].AsDouble();
+    settings.bus_label_offset[1] = dict.at("bus_label_offset"sv).AsArray()[1].AsDouble();
+    settings.stop_label_font_size = dict.at("stop_label_font_size"sv).AsInt();
+    settings.stop_label_offset[0] = dict.at("stop_label_offset"sv).AsArray()[0].AsDouble();
+    settings.stop_label_offset[1] = dict.at("stop_label_offset"sv).AsArray()[1].AsDouble();
+    settings.underlayer_color = LoadColor(dict.at("underlayer_color"sv));
+    settings.underlayer_width = dict.at("underlayer_width"sv).AsDouble();
+
+    const json::Array& array = dict.at("color_palette"sv).AsArray();
     settings.color_palette.reserve(array.size());
     for (const auto& it : array) {
         settings.color_palette.emplace_back(LoadColor(it));
     }
 
+    // необязательные настройки детализации
+    if (dict.count("simplify_tolerance"sv)) {
+        settings.simplify_tolerance = dict.at("simplify_tolerance"sv).AsDouble();
+    }
+    if (dict.count("merge_shared_segments"sv)) {
+        settings.merge_shared_segments = dict.at("merge_shared_segments"sv).AsBool();
+    }
+
+    // необязательные настройки компактного вывода
+    if (dict.count("compact_svg"sv)) {
+        settings.compact_svg = dict.at("compact_svg"sv).AsBool();
+    }
+    if (dict.count("svg_precision"sv)) {
+        settings.svg_precision = std::clamp(dict.at("svg_precision"sv).AsInt(), -1, 17);
+    }
+
+    if (dict.count("threads"sv)) {
+        settings.threads = static_cast<size_t>(std::max(dict.at("threads"sv).AsInt(), 0));
+    }
+
     renderer_.SetSettings(settings);
 }
 
 void JsonReader::LoadRouting(const json::Dict& dict) {
     transport_router::RouterSettings settings;
 
-    settings.bus_wait_time = dict.at("bus_wait_time"s).AsInt();
+    settings.bus_wait_time = dict.at("bus_wait_time"sv).AsInt();
     settings.bus_wait_time *= 60; // time in seconds
-    settings.bus_velocity = dict.at("bus_velocity"s).AsInt();
+    settings.bus_velocity = dict.at("bus_velocity"sv).AsInt();
     settings.bus_velocity /= 3.6; // velocity in meter per second
 
     router_.SetSettings(settings);
@@ -272,239 +422,529 @@ void JsonReader::LoadRouting(const json::Dict& dict) {
 void JsonReader::LoadSerialization(const json::Dict& dict) {
     serialization::SerializatorSettings settings;
 
-    settings.path = dict.at("file"s).AsString();
+    settings.path = dict.at("file"sv).AsString();
+
+    if (dict.count("threads"sv) > 0) {
+        settings.threads = static_cast<size_t>(std::max(dict.at("threads"sv).AsInt(), 0));
+    }
+
+    if (dict.count("compact"sv) > 0) {
+        settings.compact = dict.at("compact"sv).AsBool();
+    }
+
+    if (dict.count("precompute_responses"sv) > 0) {
+        settings.precompute_responses = dict.at("precompute_responses"sv).AsBool();
+    }
+
+    if (dict.count("precompute_map"sv) > 0) {
+        settings.precompute_map = dict.at("precompute_map"sv).AsBool();
+    }
+
+    if (dict.count("compression"sv) > 0) {
+        const std::string& compression = dict.at("compression"sv).AsString();
+        if (compression == "gzip"s) {
+            settings.compression = serialization::Compression::GZIP;
+        } else if (compression != "none"s) {
+            throw std::invalid_argument("unknown compression "s + compression);
+        }
+    }
 
     serializator_.SetSettings(settings);
 }
 
 void JsonReader::Parse() {
-    // проходим по всем запросам, обрабатываем только StopQuery
-    for (const auto& it : queries_) {
-        if (details::StopQuery* stop_query = dynamic_cast<details::StopQuery*>(it.get())) {
-            // добавляем в каталог остановки
-            catalogue_.addStop(stop_query->name, stop_query->coordinates);
-        }
+    trace::Scope scope("Parse");
+
+    BuildCatalogue();
+    BuildBusInfo();
+
+    // строим маршрут
+    router_.CalcRoute();
+
+    // готовые ответы на Stop и Bus
+    if (serializator_.GetSettings().precompute_responses) {
+        trace::Scope scope("PrecomputeResponses");
+        BuildResponses();
     }
 
-    // проходим по всем запросам, обрабатываем только StopQuery
-    for (const auto& it : queries_) {
-        if (details::StopQuery* stop_query = dynamic_cast<details::StopQuery*>(it.get())) {
-            std::vector<std::pair<int, std::string>> vct_distance;
-            for(auto& [dist, stop_to] : stop_query->distances) {
-                vct_distance.push_back(make_pair(dist, stop_to));
-                // добавляем в каталог расстояния между остановками
-                catalogue_.setDistance(stop_query->name, stop_to, dist);
-            }
-            // запоминаем расстояния для остановки (для сериализации)
-            if (!vct_distance.empty()) {
-                catalogue_.addStopDistance(stop_query->name, vct_distance);
+    // готовая карта, обычная и сжатая
+    if (serializator_.GetSettings().precompute_map) {
+        trace::Scope scope("PrecomputeMap");
+        request_handler::RequestHandler request_handler(catalogue_, renderer_, router_);
+        request_handler.PrepareRender();
+        GetMap(request_handler, true);
+    }
+
+    // сериализация данных каталога
+    serializator_.Serialize();
+}
+
+void JsonReader::BuildCatalogue() {
+    trace::Scope scope("BuildCatalogue");
+
+    // все остановки уже в каталоге, добавляем расстояния между ними
+    {
+        trace::Scope scope("SetDistances");
+        for (const auto& [stop_from, distances] : catalogue_.getStopDistance()) {
+            for (const auto& [dist, stop_to] : distances) {
+                catalogue_.setDistance(stop_from, stop_to, dist);
             }
         }
     }
 
-    // проходим по всем запросам, обрабатываем только BusQuery
+    catalogue_.reserve(catalogue_.getStops().size(), bus_queries_.size());
+
+    // дальше все считается по координатам в том виде, в каком их сохранит база
+    serializator_.RoundCoordinates();
+
+    // добавляем маршруты
+    for (const auto& bus_query : bus_queries_) {
+        catalogue_.addBus(bus_query.name, bus_query.name_last_stop, bus_query.is_roundtrip, bus_query.stops);
+    }
+}
+
+void JsonReader::BuildBusInfo() {
+    trace::Scope scope("BusInfo");
+
+    // формируем информацию о маршрутах в порядке ввода
+    for (const auto& bus_query : bus_queries_) {
+        const domain::Bus* bus = catalogue_.findBus(bus_query.name);
+        catalogue_.addBusInfo(bus, catalogue_.calcBusInfo(bus->stops));
+    }
+
+    // маршруты больше не нужны
+    bus_queries_.clear();
+    bus_queries_.shrink_to_fit();
+}
+
+void JsonReader::Print(std::ostream& out, request_handler::RequestHandler& request_handler, bool compact) {
+    trace::Scope scope("Print");
+
+    // ответы выводятся по мере вычисления, результат должен быть в массиве
+    json::Writer writer(out, !compact);
+
+    writer.StartArray();
+
     for (const auto& it : queries_) {
-        if (details::BusQuery* bus_query = dynamic_cast<details::BusQuery*>(it.get())) {
-            // добавляем маршруты
-            catalogue_.addBus(bus_query->name, bus_query->name_last_stop, bus_query->is_roundtrip, bus_query->stops);
+        if (details::StatQuery* stat_query = dynamic_cast<details::StatQuery*>(it.get())) {
+            PrintStat(writer, *stat_query, request_handler);
+        }
+    }
+
+    writer.EndArray();
+}
 
-            // формируем информацию о маршруте
-            transport_catalogue::BusInfo info;
+void JsonReader::Freeze(request_handler::RequestHandler& request_handler) {
+    // данные визуализатора и индекс готовятся всегда: при готовой карте
+    // GetMap их не трогает, а тайлы и области рисуются из нескольких потоков
+    request_handler.PrepareRender();
+    // обе формы полной карты
+    GetMap(request_handler, true);
+}
 
-            const domain::Bus* bus = catalogue_.findBus(bus_query->name);
+namespace {
 
-            std::unordered_set<std::string_view> stop_storage;
+// буфер на стеке под документ одного запроса; больше - берется из кучи
+constexpr size_t REQUEST_BUFFER_SIZE = 1024;
 
-            info.stop_number = static_cast<int>(bus->stops.size());
+} // namespace
 
-            double geo_distance = 0;
+bool JsonReader::ProcessRequest(std::string_view request, std::ostream& out,
+                                request_handler::RequestHandler& request_handler) {
+    if (request.find_first_not_of(" \t\r"sv) == request.npos) {
+        return false;
+    }
 
-            const domain::Stop* previous = nullptr;
-            for(const domain::Stop* current : bus->stops) {
-                stop_storage.emplace(current->name);
-                if(previous) {
-                    info.distance += catalogue_.getDistance(previous, current);
-                    geo_distance += ComputeDistance(previous->coordinates, current->coordinates);
-                }
-                previous = current;
-            }
+    json::Writer writer(out, false);
 
-            info.unique_stop_number = static_cast<int>(stop_storage.size());
+    std::optional<int> id;
+    details::StatQuery stat_query;
 
-            info.curvature = info.distance/geo_distance;
+    // документ одного запроса помещается в буфер на стеке
+    std::byte buffer[REQUEST_BUFFER_SIZE];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
 
-            catalogue_.addBusInfo(bus, info);
+    // ошибки разбора выводятся ответом, вывод еще не начат
+    try {
+        const json::Document document = json::Load(request, &arena);
+        const json::Dict& dict = document.GetRoot().AsMap();
+        if (dict.count("id"sv) && dict.at("id"sv).IsInt()) {
+            id = dict.at("id"sv).AsInt();
         }
+        stat_query = details::QueryStat(dict);
+    }
+    catch (const std::exception& e) {
+        PrintError(writer, id, e.what());
+        return true;
     }
 
-    // строим маршрут
-    router_.CalcRoute();
+    if (stat_query.type == details::query_type::EMPTY) {
+        PrintError(writer, id, "unknown request type"sv);
+    } else {
+        PrintStat(writer, stat_query, request_handler);
+    }
+    return true;
+}
 
-    // сериализация данных каталога
-    serializator_.Serialize();
+void JsonReader::ProcessLines(std::istream& in, std::ostream& out, request_handler::RequestHandler& request_handler) {
+    // в памяти только текущая строка и ее ответ
+    std::string line;
+    while (std::getline(in, line)) {
+        if (ProcessRequest(line, out, request_handler)) {
+            out << std::endl;
+        }
+    }
 }
 
-void JsonReader::Print(std::ostream& out, request_handler::RequestHandler& request_handler) {
-    // результат должен быть в массиве
-    json::Array Arr;
+memory::Usage JsonReader::MemoryUsage() const {
+    memory::Usage usage("requests"s);
 
-    // резервируем место
-    Arr.reserve(stat_count);
+    usage.Add("document"s, document_bytes_);
 
-    for (const auto& it : queries_) {
-        if (details::StatQuery* stat_query = dynamic_cast<details::StatQuery*>(it.get())) {
-            if (stat_query->type == details::query_type::STOP) {
-                // формируем словарь
-                json::Dict dict;
-
-                try {
-                    const domain::Stop* stop = catalogue_.findStop(stat_query->name);
-
-                    if(0 == catalogue_.getBusesNumOnStop(stop)) {
-                        // остановка объявлена, но не входит ни в один из маршрутов
-
-                        dict = json::Builder{}.
-                            StartDict().
-                            Key("buses"s).Value(json::Array{}).
-                            Key("request_id"s).Value(stat_query->id).
-                            EndDict().
-                            Build().AsMap();
-                    } else {
-                        std::vector<const domain::Bus*> buses = catalogue_.getBusesOnStop(stop);
-
-                        // должен быть алфавитный порядок
-                        std::sort(buses.begin(), buses.end(),
-                                  [](const domain::Bus* bus1, const domain::Bus* bus2) {
-                                      return bus1->name < bus2->name;
-                                  });
-
-                        json::Array arr_buses;
-
-                        for (const auto& it : buses) {
-                            arr_buses.emplace_back(static_cast<std::string>(it->name));
-                        }
-
-                        dict = json::Builder{}.
-                            StartDict().
-                            Key("buses"s).Value(arr_buses).
-                            Key("request_id"s).Value(stat_query->id).
-                            EndDict().
-                            Build().AsMap();
-                    }
-                }
-                catch(std::invalid_argument&) {
-                    dict = json::Builder{}.
-                        StartDict().
-                        Key("request_id"s).Value(stat_query->id).
-                        Key("error_message"s).Value("not found"s).
-                        EndDict().
-                        Build().AsMap();
-                }
-
-                Arr.emplace_back(std::move(dict));
-            }
-            else if (stat_query->type == details::query_type::BUS) {
-                // формируем словарь
-                json::Dict dict;
-
-                try {
-                    const transport_catalogue::BusInfo bus_info = catalogue_.getBusInfo(stat_query->name);
-
-                    dict = json::Builder{}.
-                        StartDict().
-                        Key("curvature"s).Value(bus_info.curvature).
-                        Key("request_id"s).Value(stat_query->id).
-                        Key("route_length"s).Value(static_cast<double>(bus_info.distance)).
-                        Key("stop_count"s).Value(bus_info.stop_number).
-                        Key("unique_stop_count"s).Value(bus_info.unique_stop_number).
-                        EndDict().
-                        Build().AsMap();
-                }
-                catch(std::invalid_argument&) {
-                    dict = json::Builder{}.
-                        StartDict().
-                        Key("request_id"s).Value(stat_query->id).
-                        Key("error_message"s).Value("not found"s).
-                        EndDict().
-                        Build().AsMap();
-                }
-
-                Arr.emplace_back(std::move(dict));
-            }
-            else if (stat_query->type == details::query_type::MAP) {
-                // формируем карту
-                std::stringstream stream;
-                request_handler.RenderMap(stream);
-
-                // формируем словарь
-                json::Dict dict = json::Builder{}.
-                    StartDict().
-                    Key("request_id"s).Value(stat_query->id).
-                    Key("map"s).Value(stream.str()).
-                    EndDict().
-                    Build().AsMap();
-
-                Arr.emplace_back(std::move(dict));
-            }
-            else if (stat_query->type == details::query_type::ROUTE) {
-                // формируем словарь
-                json::Dict dict;
-                double total_time = 0.0;
-
-                // формируем оптимальный маршрут
-                auto route = router_.GetRoute(stat_query->from, stat_query->to);
-
-                if (!route.has_value()) {
-                    dict = json::Builder{}.
-                        StartDict().
-                        Key("request_id"s).Value(stat_query->id).
-                        Key("error_message"s).Value("not found"s).
-                        EndDict().
-                        Build().AsMap();
-                }
-                else {
-                    json::Array arr_items;
-
-                    for (const auto it : route.value()) {
-                        arr_items.push_back(json::Builder{}.
-                            StartDict().
-                            Key("type"s).Value("Wait"s).
-                            Key("stop_name"s).Value(static_cast<std::string>(it->from->name)).
-                            Key("time"s).Value(it->trip.waiting_time/60.0).
-                            EndDict().
-                            Build().AsMap());
-                        total_time += it->trip.waiting_time/60.0;
-
-                        arr_items.push_back(json::Builder{}.
-                            StartDict().
-                            Key("type"s).Value("Bus"s).
-                            Key("bus"s).Value(static_cast<std::string>(it->route->name)).
-                            Key("span_count"s).Value(it->trip.stops_number).
-                            Key("time"s).Value(it->trip.travel_time/60.0).
-                            EndDict().
-                            Build().AsMap());
-                        total_time += it->trip.travel_time/60.0;
-                    }
-
-                    dict = json::Builder{}.
-                        StartDict().
-                        Key("request_id"s).Value(stat_query->id).
-                        Key("total_time"s).Value(total_time).
-                        Key("items"s).Value(arr_items).
-                        EndDict().
-                        Build().AsMap();
-                }
-
-                Arr.emplace_back(std::move(dict));
-            }
+    size_t queries = memory::VectorBytes(queries_);
+    for (const auto& query : queries_) {
+        if (const auto* stat_query = dynamic_cast<const details::StatQuery*>(query.get())) {
+            queries += sizeof(*stat_query) + memory::StringBytes(stat_query->name)
+                     + memory::StringBytes(stat_query->from) + memory::StringBytes(stat_query->to);
         }
     }
+    usage.Add("queries"s, queries);
+
+    usage.Add("viewports"s, viewports_.MemoryUsage());
+
+    return usage;
+}
+
+namespace {
+
+// Делит компактный ответ на части до и после значения request_id.
+// Неэкранированная последовательность "request_id": встречается только как ключ
+response_cache::Fragment SplitResponse(const std::string& response) {
+    static const std::string key = "\"request_id\":"s;
+
+    const size_t head_end = response.find(key) + key.size();
+    const size_t tail_begin = response.find_first_not_of("-0123456789"sv, head_end);
+
+    return {response.substr(0, head_end), response.substr(tail_begin)};
+}
+
+} // namespace
+
+void JsonReader::BuildResponses() {
+    details::StatQuery query;
+
+    for (const auto& [name, stop] : catalogue_.getStops()) {
+        std::ostringstream stream;
+        json::Writer writer(stream, false);
+
+        query.name = static_cast<std::string>(name);
+        PrintStop(writer, query);
+
+        responses_.SetStop(name, SplitResponse(stream.str()));
+    }
+
+    for (const auto& [name, bus] : catalogue_.getBuses()) {
+        std::ostringstream stream;
+        json::Writer writer(stream, false);
+
+        query.name = static_cast<std::string>(name);
+        PrintBus(writer, query);
+
+        responses_.SetBus(name, SplitResponse(stream.str()));
+    }
+}
+
+namespace {
+
+// карта в виде JSON-строки: исходный SVG или сжатый и закодированный в base64
+std::string MapToJson(const std::string& svg, bool compressed) {
+    std::ostringstream json_stream;
+    if (compressed) {
+        json::Writer(json_stream).Value(compression::Base64Encode(compression::Gzip(svg)));
+    } else {
+        json::Writer(json_stream).Value(svg);
+    }
+    return json_stream.str();
+}
+
+} // namespace
+
+const std::string& JsonReader::GetMap(request_handler::RequestHandler& request_handler, bool compressed) {
+    // карта зависит только от базы, строим ее один раз
+    if (const std::string* map = compressed ? responses_.GetCompressedMap() : responses_.GetMap()) {
+        metrics::Add(metrics::Get().map_hits);
+        return *map;
+    }
+    metrics::Add(metrics::Get().map_misses);
+
+    std::ostringstream svg_stream;
+    request_handler.RenderMap(svg_stream);
+    const std::string svg = svg_stream.str();
+
+    // храним уже экранированную JSON-строку
+    if (!responses_.GetMap()) {
+        responses_.SetMap(MapToJson(svg, false));
+    }
+    if (compressed) {
+        responses_.SetCompressedMap(MapToJson(svg, true));
+        return *responses_.GetCompressedMap();
+    }
+
+    return *responses_.GetMap();
+}
+
+response_cache::ViewportCache::Map JsonReader::GetViewportMap(const details::StatQuery& stat_query,
+                                                              request_handler::RequestHandler& request_handler) {
+    const map_renderer::Viewport viewport = stat_query.tile
+        ? request_handler.GetTile(stat_query.tile->z, stat_query.tile->x, stat_query.tile->y)
+        : *stat_query.bbox;
+
+    // ключ - точные значения границ области
+    std::string key;
+    char buffer[32];
+    for (double value : {viewport.min.lat, viewport.min.lng, viewport.max.lat, viewport.max.lng}) {
+        auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value);
+        key.append(buffer, ptr);
+        key += ' ';
+    }
+    if (stat_query.compressed) {
+        key += "gzip"sv;
+    }
 
-    // формируем документ
-    json::Document document(Arr);
+    if (auto map = viewports_.Find(key)) {
+        metrics::Add(metrics::Get().map_hits);
+        return map;
+    }
+    metrics::Add(metrics::Get().map_misses);
+
+    std::ostringstream svg_stream;
+    request_handler.RenderViewport(svg_stream, viewport);
+
+    return viewports_.Put(std::move(key), MapToJson(svg_stream.str(), stat_query.compressed));
+}
+
+bool JsonReader::PrintFragment(json::Writer& writer, const response_cache::Fragment* fragment, int id) {
+    // готовые ответы хранятся только в компактном виде
+    if (!fragment || writer.IsIndented()) {
+        metrics::Add(metrics::Get().response_misses);
+        return false;
+    }
+    metrics::Add(metrics::Get().response_hits);
+
+    // буфер для сборки ответа с request_id, свой у каждого потока
+    thread_local std::string buffer;
+
+    buffer = fragment->head;
+    buffer += std::to_string(id);
+    buffer += fragment->tail;
+
+    writer.RawValue(buffer);
+
+    return true;
+}
+
+void JsonReader::PrintStat(json::Writer& writer, const details::StatQuery& stat_query,
+                           request_handler::RequestHandler& request_handler) {
+    if (stat_query.type == details::query_type::STATS) {
+        PrintStats(writer, stat_query);
+        return;
+    }
+
+    metrics::Metrics& process_metrics = metrics::Get();
+    metrics::Histogram* latency = nullptr;
+    const auto start = std::chrono::steady_clock::now();
+
+    if (stat_query.type == details::query_type::STOP) {
+        trace::Scope scope("Stop");
+        PrintStop(writer, stat_query);
+        latency = &process_metrics.stop_latency;
+    } else if (stat_query.type == details::query_type::BUS) {
+        trace::Scope scope("Bus");
+        PrintBus(writer, stat_query);
+        latency = &process_metrics.bus_latency;
+    } else if (stat_query.type == details::query_type::MAP) {
+        trace::Scope scope("Map");
+        PrintMap(writer, stat_query, request_handler);
+        latency = &process_metrics.map_latency;
+    } else if (stat_query.type == details::query_type::ROUTE) {
+        trace::Scope scope("Route");
+        PrintRoute(writer, stat_query);
+        latency = &process_metrics.route_latency;
+    }
+
+    if (latency) {
+        const auto duration = std::chrono::steady_clock::now() - start;
+        latency->Record(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+}
+
+// ключи словарей выводятся в алфавитном порядке, как у json::Dict
+
+void JsonReader::PrintNotFound(json::Writer& writer, int id) {
+    PrintError(writer, id, "not found"sv);
+}
+
+void JsonReader::PrintError(json::Writer& writer, std::optional<int> id, std::string_view message) {
+    metrics::Add(metrics::Get().errors);
+
+    writer.StartDict().Key("error_message"sv).Value(message);
+    if (id) {
+        writer.Key("request_id"sv).Value(*id);
+    }
+    writer.EndDict();
+}
+
+void JsonReader::PrintStop(json::Writer& writer, const details::StatQuery& stat_query) {
+    if (PrintFragment(writer, responses_.FindStop(stat_query.name), stat_query.id)) {
+        return;
+    }
+
+    const domain::Stop* stop = catalogue_.findStop(stat_query.name);
+    if (!stop) {
+        PrintNotFound(writer, stat_query.id);
+        return;
+    }
+
+    std::vector<const domain::Bus*> buses;
+
+    // остановка может быть объявлена, но не входить ни в один из маршрутов
+    if (const auto* stop_buses = catalogue_.findBusesOnStop(stop)) {
+        buses.assign(stop_buses->begin(), stop_buses->end());
+
+        // должен быть алфавитный порядок
+        std::sort(buses.begin(), buses.end(),
+                  [](const domain::Bus* bus1, const domain::Bus* bus2) {
+                      return bus1->name < bus2->name;
+                  });
+    }
+
+    writer.StartDict().Key("buses"sv).StartArray();
+    for (const auto& bus : buses) {
+        writer.Value(bus->name);
+    }
+    writer.EndArray().
+        Key("request_id"sv).Value(stat_query.id).
+        EndDict();
+}
+
+void JsonReader::PrintBus(json::Writer& writer, const details::StatQuery& stat_query) {
+    if (PrintFragment(writer, responses_.FindBus(stat_query.name), stat_query.id)) {
+        return;
+    }
+
+    const transport_catalogue::BusInfo* bus_info = catalogue_.findBusInfo(stat_query.name);
+    if (!bus_info) {
+        PrintNotFound(writer, stat_query.id);
+        return;
+    }
+
+    writer.StartDict().
+        Key("curvature"sv).Value(bus_info->curvature).
+        Key("request_id"sv).Value(stat_query.id).
+        Key("route_length"sv).Value(static_cast<double>(bus_info->distance)).
+        Key("stop_count"sv).Value(bus_info->stop_number).
+        Key("unique_stop_count"sv).Value(bus_info->unique_stop_number).
+        EndDict();
+}
+
+void JsonReader::PrintMap(json::Writer& writer, const details::StatQuery& stat_query,
+                          request_handler::RequestHandler& request_handler) {
+    // карта области может быть вытеснена из кэша другим потоком, пока выводится
+    const response_cache::ViewportCache::Map viewport_map = stat_query.bbox || stat_query.tile
+        ? GetViewportMap(stat_query, request_handler)
+        : nullptr;
+
+    const std::string& map = viewport_map ? *viewport_map : GetMap(request_handler, stat_query.compressed);
+    metrics::Add(metrics::Get().map_bytes, map.size());
+
+    writer.StartDict();
+    if (stat_query.compressed) {
+        writer.Key("compression"sv).Value("gzip"sv);
+    }
+    writer.
+        Key("map"sv).RawValue(map).
+        Key("request_id"sv).Value(stat_query.id).
+        EndDict();
+}
+
+void JsonReader::PrintRoute(json::Writer& writer, const details::StatQuery& stat_query) {
+    // формируем оптимальный маршрут
+    auto route = router_.GetRoute(stat_query.from, stat_query.to);
+
+    if (!route.has_value()) {
+        PrintNotFound(writer, stat_query.id);
+        return;
+    }
+
+    metrics::Add(metrics::Get().route_edges, route->size());
+
+    double total_time = 0.0;
+
+    writer.StartDict().Key("items"sv).StartArray();
+
+    for (const auto it : route.value()) {
+        writer.StartDict().
+            Key("stop_name"sv).Value(it->from->name).
+            Key("time"sv).Value(it->trip.waiting_time/60.0).
+            Key("type"sv).Value("Wait"sv).
+            EndDict();
+        total_time += it->trip.waiting_time/60.0;
+
+        writer.StartDict().
+            Key("bus"sv).Value(it->route->name).
+            Key("span_count"sv).Value(it->trip.stops_number).
+            Key("time"sv).Value(it->trip.travel_time/60.0).
+            Key("type"sv).Value("Bus"sv).
+            EndDict();
+        total_time += it->trip.travel_time/60.0;
+    }
+
+    writer.EndArray().
+        Key("request_id"sv).Value(stat_query.id).
+        Key("total_time"sv).Value(total_time).
+        EndDict();
+}
+
+namespace {
+
+void PrintLatency(json::Writer& writer, std::string_view name, const metrics::Histogram& histogram) {
+    // наносекунды в микросекунды
+    auto to_us = [](double value) {
+        return value / 1000.0;
+    };
+
+    writer.Key(name).StartDict().
+        Key("count"sv).Value(histogram.GetCount()).
+        Key("max_us"sv).Value(to_us(histogram.GetMax())).
+        Key("mean_us"sv).Value(to_us(histogram.GetMean())).
+        Key("p50_us"sv).Value(to_us(histogram.GetQuantile(0.5))).
+        Key("p999_us"sv).Value(to_us(histogram.GetQuantile(0.999))).
+        Key("p99_us"sv).Value(to_us(histogram.GetQuantile(0.99))).
+        EndDict();
+}
 
-    // печатаем документ
-    json::Print(document, out);
+} // namespace
+
+void JsonReader::PrintStats(json::Writer& writer, const details::StatQuery& stat_query) {
+    const metrics::Metrics& process_metrics = metrics::Get();
+
+    // счетчики могут увеличиваться другими потоками во время вывода
+    writer.StartDict().Key("counters"sv).StartDict().
+        Key("errors"sv).Value(metrics::Read(process_metrics.errors)).
+        Key("map_bytes"sv).Value(metrics::Read(process_metrics.map_bytes)).
+        Key("map_hits"sv).Value(metrics::Read(process_metrics.map_hits)).
+        Key("map_misses"sv).Value(metrics::Read(process_metrics.map_misses)).
+        Key("response_hits"sv).Value(metrics::Read(process_metrics.response_hits)).
+        Key("response_misses"sv).Value(metrics::Read(process_metrics.response_misses)).
+        Key("route_edges"sv).Value(metrics::Read(process_metrics.route_edges)).
+        EndDict().
+        Key("request_id"sv).Value(stat_query.id).
+        Key("requests"sv).StartDict();
+    PrintLatency(writer, "Bus"sv, process_metrics.bus_latency);
+    PrintLatency(writer, "Map"sv, process_metrics.map_latency);
+    PrintLatency(writer, "Route"sv, process_metrics.route_latency);
+    PrintLatency(writer, "Stop"sv, process_metrics.stop_latency);
+    writer.EndDict().EndDict();
 }
 
 } // namespace json_reader
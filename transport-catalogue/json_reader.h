@@ -1,11 +1,14 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 
 #include "geo.h"
 #include "request_handler.h"
 #include "json.h"
 #include "map_renderer.h"
+#include "memory.h"
+#include "response_cache.h"
 #include "transport_router.h"
 #include "serialization.h"
 
@@ -18,7 +21,8 @@ enum class query_type {
     STOP,
     BUS,
     MAP,
-    ROUTE
+    ROUTE,
+    STATS
 };
 
 struct Query {
@@ -27,16 +31,20 @@ struct Query {
     virtual ~Query() = default;
 };
 
-struct StopQuery : public Query {
+struct BusQuery : public Query {
     std::string name;
-    geo_coord::Coordinates coordinates{0, 0};
-    std::vector<std::pair<int, std::string>> distances;
+    bool is_roundtrip = false;
+    std::string name_last_stop;
+    std::vector<std::string> stops;
 };
 
-struct BusQuery : public Query {
+// запрос на заполнение базы в том виде, в котором он читается из потока
+struct BaseRequest {
+    std::string type;
     std::string name;
+    geo_coord::Coordinates coordinates{0, 0};
+    std::vector<std::pair<int, std::string>> distances;
     bool is_roundtrip = false;
-    std::string name_last_stop;
     std::vector<std::string> stops;
 };
 
@@ -44,16 +52,27 @@ struct MapQuery : public Query {
     std::string name;
 };
 
+// тайл карты z/x/y
+struct MapTile {
+    int z = 0;
+    int x = 0;
+    int y = 0;
+};
+
 struct StatQuery : public Query {
     std::string name;
     std::string from;
     std::string to;
     int id = 0;
-};
 
-StopQuery QueryStop(const json::Dict& dict);
+    // для карты: область или тайл, без них выводится вся карта
+    std::optional<map_renderer::Viewport> bbox;
+    std::optional<MapTile> tile;
+    // карта сжимается gzip и кодируется base64
+    bool compressed = false;
+};
 
-BusQuery QueryBus(const json::Dict& dict);
+BusQuery QueryBus(BaseRequest&& request);
 
 MapQuery QueryMap(const json::Dict& dict);
 
@@ -68,23 +87,54 @@ public:
     explicit JsonReader(transport_catalogue::TransportCatalogue& catalogue,
                         map_renderer::MapRenderer& renderer,
                         transport_router::TransportRouter& router,
-                        serialization::Serializator& serializator);
+                        serialization::Serializator& serializator,
+                        response_cache::ResponseCache& responses);
 
     void GeneralLoadBase(std::istream& input);
-    void GeneralLoadRequests(std::istream& input);
+    // false, если база из serialization_settings не прочитана
+    bool GeneralLoadRequests(std::istream& input);
 
     void Parse();
 
-    void Print(std::ostream& out, request_handler::RequestHandler& request_handler);
+    // Части Parse по порядку (отдельно их вызывает бенчмарк): расстояния
+    // и маршруты из загруженных запросов, затем информация о маршрутах
+    void BuildCatalogue();
+    void BuildBusInfo();
+
+    // compact - вывод без отступов и переводов строк
+    void Print(std::ostream& out, request_handler::RequestHandler& request_handler, bool compact = false);
+
+    // Строит заранее все, что запросы создают при первом обращении (данные
+    // для карты и саму карту). После этого ProcessRequest только читает общие данные
+    void Freeze(request_handler::RequestHandler& request_handler);
+
+    // Отвечает на один запрос (JSON-объект из stat_requests) одной строкой без перевода строки;
+    // на пустую строку ничего не выводит и возвращает false.
+    // После Freeze можно вызывать из нескольких потоков одновременно
+    bool ProcessRequest(std::string_view request, std::ostream& out,
+                        request_handler::RequestHandler& request_handler);
+
+    // NDJSON: запрос в каждой строке in, ответ на него сразу выводится строкой в out
+    void ProcessLines(std::istream& in, std::ostream& out, request_handler::RequestHandler& request_handler);
+
+    // оценка памяти в куче: JSON-документ запросов (пока он был загружен), запросы и карты областей
+    memory::Usage MemoryUsage() const;
 
 private:
     transport_catalogue::TransportCatalogue& catalogue_;
     map_renderer::MapRenderer& renderer_;
     transport_router::TransportRouter& router_;
     serialization::Serializator& serializator_;
+    response_cache::ResponseCache& responses_;
     std::vector<std::unique_ptr<details::Query>> queries_;
 
-    void LoadBase(const json::Array& vct);
+    // маршруты ждут, пока будут прочитаны все остановки
+    std::vector<details::BusQuery> bus_queries_;
+
+    // потоковый разбор запросов на заполнение базы
+    class BaseHandler;
+
+    void AddBaseRequest(details::BaseRequest&& request);
     void LoadStat(const json::Array& vct);
     svg::Color LoadColor(const json::Node& node);
     void LoadRender(const json::Dict& dict);
@@ -92,6 +142,29 @@ private:
     void LoadSerialization(const json::Dict& dict);
 
     size_t stat_count = 0;
+
+    // документ stat_requests удаляется после загрузки, его размер запоминается
+    size_t document_bytes_ = 0;
+
+    // карты областей и тайлов
+    response_cache::ViewportCache viewports_;
+
+    void BuildResponses();
+    const std::string& GetMap(request_handler::RequestHandler& request_handler, bool compressed = false);
+    response_cache::ViewportCache::Map GetViewportMap(const details::StatQuery& stat_query,
+                                                      request_handler::RequestHandler& request_handler);
+    bool PrintFragment(json::Writer& writer, const response_cache::Fragment* fragment, int id);
+
+    void PrintStat(json::Writer& writer, const details::StatQuery& stat_query,
+                   request_handler::RequestHandler& request_handler);
+    void PrintNotFound(json::Writer& writer, int id);
+    void PrintError(json::Writer& writer, std::optional<int> id, std::string_view message);
+    void PrintStop(json::Writer& writer, const details::StatQuery& stat_query);
+    void PrintBus(json::Writer& writer, const details::StatQuery& stat_query);
+    void PrintMap(json::Writer& writer, const details::StatQuery& stat_query,
+                  request_handler::RequestHandler& request_handler);
+    void PrintRoute(json::Writer& writer, const details::StatQuery& stat_query);
+    void PrintStats(json::Writer& writer, const details::StatQuery& stat_query);
 };
 
 } // namespace json_reader
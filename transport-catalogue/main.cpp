@@ -1,45 +1,140 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string_view>
 
 #include "transport_catalogue.h"
 #include "json_reader.h"
+#include "memory.h"
 #include "request_handler.h"
+#include "response_cache.h"
+#include "server.h"
+#include "trace.h"
 #include "transport_router.h"
 
 using namespace std::literals;
 
 void PrintUsage(std::ostream& stream = std::cerr) {
-    stream << "Usage: transport_catalogue [make_base|process_requests]\n"sv;
+    stream << "Usage: transport_catalogue [make_base|process_requests] [--compact|--ndjson] [--trace FILE] [--memory-report]\n"sv;
+    stream << "       transport_catalogue serve --settings FILE [--socket PATH] [--workers N] [--processes N] [--reload MS]"
+              " [--trace FILE] [--memory-report]\n"sv;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    if (argc < 2) {
         PrintUsage();
         return 1;
     }
 
     const std::string_view mode(argv[1]);
 
+    // вывод ответов без отступов
+    bool compact = false;
+    // запросы и ответы по одному в строке
+    bool ndjson = false;
+    // оценка памяти по структурам в stderr в конце работы
+    bool memory_report = false;
+
+    // для serve: файл с serialization_settings и настройки сервера
+    std::string settings_path;
+    server::ServerSettings server_settings;
+
+    // файл трассы в формате Chrome trace-event, можно задать и переменной окружения
+    std::string trace_path;
+    if (const char* env_trace = std::getenv("TRANSPORT_CATALOGUE_TRACE")) {
+        trace_path = env_trace;
+    }
+
+    for (int i = 2; i < argc; ++i) {
+        if (argv[i] == "--compact"sv) {
+            compact = true;
+        } else if (argv[i] == "--ndjson"sv) {
+            ndjson = true;
+        } else if (argv[i] == "--memory-report"sv) {
+            memory_report = true;
+        } else if (argv[i] == "--settings"sv && i + 1 < argc) {
+            settings_path = argv[++i];
+        } else if (argv[i] == "--socket"sv && i + 1 < argc) {
+            server_settings.socket_path = argv[++i];
+        } else if (argv[i] == "--workers"sv && i + 1 < argc) {
+            server_settings.workers = static_cast<size_t>(std::max(std::atoi(argv[++i]), 0));
+        } else if (argv[i] == "--processes"sv && i + 1 < argc) {
+            server_settings.processes = static_cast<size_t>(std::max(std::atoi(argv[++i]), 1));
+        } else if (argv[i] == "--reload"sv && i + 1 < argc) {
+            server_settings.reload_interval = std::chrono::milliseconds(std::max(std::atoi(argv[++i]), 0));
+        } else if (argv[i] == "--trace"sv && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (!trace_path.empty()) {
+        trace::Enable(trace_path);
+    }
+
+    if (mode == "serve"sv) {
+        if (settings_path.empty()) {
+            PrintUsage();
+            return 1;
+        }
+        // база живет в снимках сервера и перезагружается при изменении файла
+        server::Server server(settings_path, server_settings);
+        try {
+            server.Run();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            trace::Finish();
+            return 1;
+        }
+        trace::Finish();
+        if (memory_report) {
+            memory::PrintReport(std::cerr, server.MemoryUsage());
+        }
+        return 0;
+    }
+
     transport_catalogue::TransportCatalogue catalogue; // каталог
     map_renderer::MapRenderer renderer;
     transport_router::TransportRouter router(catalogue);
-    serialization::Serializator serializator(catalogue, renderer, router);
-    json_reader::JsonReader json_reader(catalogue, renderer, router, serializator);
+    response_cache::ResponseCache responses; // готовые ответы
+    serialization::Serializator serializator(catalogue, renderer, router, responses);
+    json_reader::JsonReader json_reader(catalogue, renderer, router, serializator, responses);
 
     if (mode == "make_base"sv) {
         // ввод
         json_reader.GeneralLoadBase(std::cin);
         // парсим ввод (заполняем каталог)
         json_reader.Parse();
+    } else if (mode == "process_requests"sv && ndjson) {
+        // первая строка - документ с serialization_settings, дальше по запросу в строке
+        std::string line;
+        std::getline(std::cin, line);
+        std::istringstream settings(line);
+        json_reader.GeneralLoadRequests(settings);
+
+        request_handler::RequestHandler request_handler(catalogue, renderer, router);
+        request_handler.PrepareRender();
+        json_reader.ProcessLines(std::cin, std::cout, request_handler);
     } else if (mode == "process_requests"sv) {
         json_reader.GeneralLoadRequests(std::cin);
         // запросы к каталогу
         request_handler::RequestHandler request_handler(catalogue, renderer, router);
+        request_handler.PrepareRender();
         // вывод
-        json_reader.Print(std::cout, request_handler);
+        json_reader.Print(std::cout, request_handler, compact);
     } else {
         PrintUsage();
         return 1;
     }
+
+    trace::Finish();
+    if (memory_report) {
+        memory::PrintReport(std::cerr, {catalogue.memoryUsage(), router.MemoryUsage(),
+                                        responses.MemoryUsage(), json_reader.MemoryUsage()});
+    }
 }
\ No newline at end of file
@@ -1,6 +1,13 @@
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <thread>
+#include <sstream>
+#include <unordered_set>
 
 #include "map_renderer.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 namespace map_renderer {
 
@@ -15,7 +22,12 @@ RenderSettings::RenderSettings() :
     stop_label_font_size(20),
     stop_label_offset{7.0, -3.0},
     underlayer_color(svg::Rgba{255, 255, 255, 0.85}),
-    underlayer_width(3.0)
+    underlayer_width(3.0),
+    simplify_tolerance(0.0),
+    merge_shared_segments(false),
+    compact_svg(false),
+    svg_precision(-1),
+    threads(0)
     {
 }
 
@@ -23,6 +35,44 @@ bool IsZero(double value) {
     return std::abs(value) < EPSILON;
 }
 
+SphereProjector::SphereProjector(const Viewport& bounds, double max_width, double max_height, double padding)
+    : padding_(padding) //
+{
+    SetBounds(bounds, max_width, max_height);
+}
+
+void SphereProjector::SetBounds(const Viewport& bounds, double max_width, double max_height) {
+    const double padding = padding_;
+    min_lon_ = bounds.min.lng;
+    const double max_lon = bounds.max.lng;
+    const double min_lat = bounds.min.lat;
+    max_lat_ = bounds.max.lat;
+
+    // Вычисляем коэффициент масштабирования вдоль координаты x
+    std::optional<double> width_zoom;
+    if (!IsZero(max_lon - min_lon_)) {
+        width_zoom = (max_width - 2 * padding) / (max_lon - min_lon_);
+    }
+
+    // Вычисляем коэффициент масштабирования вдоль координаты y
+    std::optional<double> height_zoom;
+    if (!IsZero(max_lat_ - min_lat)) {
+        height_zoom = (max_height - 2 * padding) / (max_lat_ - min_lat);
+    }
+
+    if (width_zoom && height_zoom) {
+        // Коэффициенты масштабирования по ширине и высоте ненулевые,
+        // берём минимальный из них
+        zoom_coeff_ = std::min(*width_zoom, *height_zoom);
+    } else if (width_zoom) {
+        // Коэффициент масштабирования по ширине ненулевой, используем его
+        zoom_coeff_ = *width_zoom;
+    } else if (height_zoom) {
+        // Коэффициент масштабирования по высоте ненулевой, используем его
+        zoom_coeff_ = *height_zoom;
+    }
+}
+
 svg::Point SphereProjector::operator()(geo_coord::Coordinates coords) const {
     return {
         (coords.lng - min_lon_) * zoom_coeff_ + padding_,
@@ -30,6 +80,14 @@ svg::Point SphereProjector::operator()(geo_coord::Coordinates coords) const {
     };
 }
 
+void SphereProjector::Project(const double* lats, const double* lngs, size_t count, svg::Point* out) const {
+    // те же вычисления, что и в operator(), без зависимостей между итерациями
+    for (size_t i = 0; i < count; ++i) {
+        out[i].x = (lngs[i] - min_lon_) * zoom_coeff_ + padding_;
+        out[i].y = (max_lat_ - lats[i]) * zoom_coeff_ + padding_;
+    }
+}
+
 void MapRenderer::SetSettings(const RenderSettings& settings) {
     settings_ = settings;
 }
@@ -38,45 +96,416 @@ const RenderSettings& MapRenderer::GetSettings() const {
     return settings_;
 }
 
-void MapRenderer::SetBuses(const std::map<std::string_view, const domain::Bus*> buses) {
-    buses_ = buses;
-}
+void MapRenderer::SetBuses(const std::map<std::string_view, const domain::Bus*>& buses) {
+    buses_.clear();
+    buses_.reserve(buses.size());
 
-void MapRenderer::SetStopToBuses(const std::unordered_map<const domain::Stop*, std::unordered_set<domain::Bus*>>& stop_to_buses) {
-    stop_to_buses_ = stop_to_buses;
+    for (const auto& [name, bus] : buses) {
+        if (!bus->stops.empty()) {
+            buses_.push_back(bus);
+        }
+    }
+    std::sort(buses_.begin(), buses_.end(), BusSort{});
 }
 
-void MapRenderer::Render(std::ostream& out) {
-    std::vector<geo_coord::Coordinates> coordinates;
+void MapRenderer::SetStopToBuses(const std::pmr::unordered_map<const domain::Stop*, std::pmr::unordered_set<domain::Bus*>>& stop_to_buses) {
+    stops_.clear();
 
     // уникальные остановки по всем маршрутам
-    for (const auto& [stop, buses] : stop_to_buses_) {
+    for (const auto& [stop, buses] : stop_to_buses) {
         if (!buses.empty()) {
-            unique_stops_.emplace(stop);
+            stops_.push_back(stop);
         }
     }
+    std::sort(stops_.begin(), stops_.end(), StopSort{});
+}
 
-    // координаты остановок
-    for(const domain::Stop* stop : unique_stops_) {
-        coordinates.emplace_back(stop->coordinates);
+bool Viewport::Contains(geo_coord::Coordinates point) const {
+    return min.lat <= point.lat && point.lat <= max.lat
+        && min.lng <= point.lng && point.lng <= max.lng;
+}
+
+bool Viewport::Intersects(const Viewport& other) const {
+    return min.lat <= other.max.lat && other.min.lat <= max.lat
+        && min.lng <= other.max.lng && other.min.lng <= max.lng;
+}
+
+namespace {
+
+// Отрезок пересекает прямоугольник, если пересекаются их описывающие прямоугольники
+// и углы прямоугольника не лежат по одну сторону от прямой отрезка
+bool SegmentIntersects(const Viewport& viewport, geo_coord::Coordinates from, geo_coord::Coordinates to) {
+    const Viewport bounds{{std::min(from.lat, to.lat), std::min(from.lng, to.lng)},
+                          {std::max(from.lat, to.lat), std::max(from.lng, to.lng)}};
+    if (!viewport.Intersects(bounds)) {
+        return false;
     }
 
-    SphereProjector projector(coordinates.begin(), coordinates.end(), settings_.width, settings_.height, settings_.padding);
+    auto side = [&](double lat, double lng) {
+        return (to.lng - from.lng) * (lat - from.lat) - (to.lat - from.lat) * (lng - from.lng);
+    };
+    const double corners[] = {
+        side(viewport.min.lat, viewport.min.lng), side(viewport.min.lat, viewport.max.lng),
+        side(viewport.max.lat, viewport.min.lng), side(viewport.max.lat, viewport.max.lng)
+    };
 
-    std::set<const domain::Bus*, BusSort> buses_to_render;
-    for (const auto& [name, bus] : buses_) {
-        if (!bus->stops.empty()) {
-            buses_to_render.emplace(bus);
+    const bool all_above = std::all_of(std::begin(corners), std::end(corners), [](double v) { return v > 0.0; });
+    const bool all_below = std::all_of(std::begin(corners), std::end(corners), [](double v) { return v < 0.0; });
+    return !all_above && !all_below;
+}
+
+// расстояние от точки до отрезка
+double SegmentDistance(svg::Point point, svg::Point from, svg::Point to) {
+    const double dx = to.x - from.x;
+    const double dy = to.y - from.y;
+    const double length2 = dx * dx + dy * dy;
+
+    double t = 0.0;
+    if (length2 > 0.0) {
+        t = std::clamp(((point.x - from.x) * dx + (point.y - from.y) * dy) / length2, 0.0, 1.0);
+    }
+
+    return std::hypot(point.x - (from.x + t * dx), point.y - (from.y + t * dy));
+}
+
+// Упрощение ломаной алгоритмом Дугласа-Пекера, крайние точки сохраняются
+void Simplify(std::vector<svg::Point>& points, double tolerance) {
+    if (points.size() < 3) {
+        return;
+    }
+
+    std::vector<bool> keep(points.size(), false);
+    keep.front() = keep.back() = true;
+
+    std::vector<std::pair<size_t, size_t>> ranges{{0, points.size() - 1}};
+    while (!ranges.empty()) {
+        const auto [first, last] = ranges.back();
+        ranges.pop_back();
+
+        double max_distance = 0.0;
+        size_t farthest = first;
+        for (size_t i = first + 1; i < last; ++i) {
+            const double distance = SegmentDistance(points[i], points[first], points[last]);
+            if (distance > max_distance) {
+                max_distance = distance;
+                farthest = i;
+            }
+        }
+
+        if (max_distance > tolerance) {
+            keep[farthest] = true;
+            ranges.emplace_back(first, farthest);
+            ranges.emplace_back(farthest, last);
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (keep[i]) {
+            points[kept++] = points[i];
+        }
+    }
+    points.resize(kept);
+}
+
+// Минимум и максимум массива. Несколько независимых аккумуляторов
+// убирают зависимость между итерациями, цикл хорошо векторизуется
+void MinMax(const double* values, size_t count, double& min_value, double& max_value) {
+    constexpr size_t LANES = 4;
+
+    double mins[LANES];
+    double maxs[LANES];
+    std::fill(std::begin(mins), std::end(mins), values[0]);
+    std::fill(std::begin(maxs), std::end(maxs), values[0]);
+
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES) {
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            mins[lane] = values[i + lane] < mins[lane] ? values[i + lane] : mins[lane];
+            maxs[lane] = values[i + lane] > maxs[lane] ? values[i + lane] : maxs[lane];
         }
     }
+    for (; i < count; ++i) {
+        mins[0] = values[i] < mins[0] ? values[i] : mins[0];
+        maxs[0] = values[i] > maxs[0] ? values[i] : maxs[0];
+    }
+
+    min_value = *std::min_element(std::begin(mins), std::end(mins));
+    max_value = *std::max_element(std::begin(maxs), std::end(maxs));
+}
+
+// минимальный размер куска слоя, который выводится отдельно
+const size_t MIN_CHUNK_SIZE = 256;
+
+// участок между остановками с номерами from и to, без учета направления
+uint64_t SegmentKey(uint32_t from, uint32_t to) {
+    return (static_cast<uint64_t>(std::min(from, to)) << 32) | std::max(from, to);
+}
 
-    RenderBuses(projector, buses_to_render);
-    RenderBusesNames(projector, buses_to_render);
+} // namespace
 
-    RenderStops(projector);
-    RenderStopsNames(projector);
+size_t MapRenderer::GridIndex::Row(double lat) const {
+    const double span = extent.max.lat - extent.min.lat;
+    if (span <= 0.0 || lat <= extent.min.lat) {
+        return 0;
+    }
+    return std::min(rows - 1, static_cast<size_t>((lat - extent.min.lat) / span * rows));
+}
 
-    document_.Render(out);
+size_t MapRenderer::GridIndex::Col(double lng) const {
+    const double span = extent.max.lng - extent.min.lng;
+    if (span <= 0.0 || lng <= extent.min.lng) {
+        return 0;
+    }
+    return std::min(cols - 1, static_cast<size_t>((lng - extent.min.lng) / span * cols));
+}
+
+void MapRenderer::BuildIndex() {
+    trace::Scope scope("BuildIndex");
+
+    index_ = {};
+    stop_lats_.clear();
+    stop_lngs_.clear();
+    bus_stops_.clear();
+    bus_last_stops_.clear();
+
+    if (stops_.empty()) {
+        return;
+    }
+
+    // номера остановок
+    std::unordered_map<const domain::Stop*, uint32_t> stop_ids;
+    stop_ids.reserve(stops_.size());
+    stop_lats_.reserve(stops_.size());
+    stop_lngs_.reserve(stops_.size());
+    for (const domain::Stop* stop : stops_) {
+        stop_ids.emplace(stop, static_cast<uint32_t>(stop_lats_.size()));
+        stop_lats_.push_back(stop->coordinates.lat);
+        stop_lngs_.push_back(stop->coordinates.lng);
+    }
+
+    bus_stops_.reserve(buses_.size());
+    bus_last_stops_.reserve(buses_.size());
+    for (const domain::Bus* bus : buses_) {
+        std::vector<uint32_t>& ids = bus_stops_.emplace_back();
+        ids.reserve(bus->stops.size());
+        for (const domain::Stop* stop : bus->stops) {
+            ids.push_back(stop_ids.at(stop));
+        }
+
+        auto last = stop_ids.find(bus->last_stop);
+        bus_last_stops_.push_back(last != stop_ids.end() ? last->second : ids.front());
+    }
+
+    MinMax(stop_lats_.data(), stop_lats_.size(), index_.extent.min.lat, index_.extent.max.lat);
+    MinMax(stop_lngs_.data(), stop_lngs_.size(), index_.extent.min.lng, index_.extent.max.lng);
+
+    // в среднем несколько остановок на ячейку
+    const size_t side = std::max<size_t>(1, static_cast<size_t>(std::sqrt(stops_.size() / 4.0)));
+    index_.rows = index_.cols = side;
+    index_.buses.resize(side * side);
+    index_.stops.resize(side * side);
+
+    for (uint32_t id = 0; id < stops_.size(); ++id) {
+        const size_t cell = index_.Row(stop_lats_[id]) * side + index_.Col(stop_lngs_[id]);
+        index_.stops[cell].push_back(id);
+    }
+
+    for (size_t bus_index = 0; bus_index < bus_stops_.size(); ++bus_index) {
+        const auto& ids = bus_stops_[bus_index];
+
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const uint32_t from = ids[i];
+            const uint32_t to = ids[std::min(i + 1, ids.size() - 1)];
+
+            const size_t row_first = index_.Row(std::min(stop_lats_[from], stop_lats_[to]));
+            const size_t row_last = index_.Row(std::max(stop_lats_[from], stop_lats_[to]));
+            const size_t col_first = index_.Col(std::min(stop_lngs_[from], stop_lngs_[to]));
+            const size_t col_last = index_.Col(std::max(stop_lngs_[from], stop_lngs_[to]));
+
+            for (size_t row = row_first; row <= row_last; ++row) {
+                for (size_t col = col_first; col <= col_last; ++col) {
+                    // маршруты обходятся по порядку, повтор возможен только в конце
+                    auto& cell = index_.buses[row * side + col];
+                    if (cell.empty() || cell.back() != bus_index) {
+                        cell.push_back(bus_index);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void MapRenderer::Render(std::ostream& out) const {
+    trace::Scope scope("RenderMap");
+
+    // границы остановок уже известны по индексу
+    SphereProjector projector(index_.extent, settings_.width, settings_.height, settings_.padding);
+
+    std::vector<size_t> buses(buses_.size());
+    for (size_t i = 0; i < buses.size(); ++i) {
+        buses[i] = i;
+    }
+
+    std::vector<uint32_t> stops(stops_.size());
+    for (uint32_t i = 0; i < stops.size(); ++i) {
+        stops[i] = i;
+    }
+
+    RenderLayers(out, projector, buses, stops);
+}
+
+const Viewport& MapRenderer::GetExtent() const {
+    return index_.extent;
+}
+
+Viewport MapRenderer::GetTile(int z, int x, int y) const {
+    const Viewport& extent = index_.extent;
+    const double tiles = std::ldexp(1.0, z);
+    const double lat_span = (extent.max.lat - extent.min.lat) / tiles;
+    const double lng_span = (extent.max.lng - extent.min.lng) / tiles;
+
+    Viewport tile;
+    tile.max.lat = extent.max.lat - y * lat_span;
+    tile.min.lat = tile.max.lat - lat_span;
+    tile.min.lng = extent.min.lng + x * lng_span;
+    tile.max.lng = tile.min.lng + lng_span;
+    return tile;
+}
+
+void MapRenderer::RenderViewport(std::ostream& out, const Viewport& viewport) const {
+    trace::Scope scope("RenderViewport");
+
+    std::vector<size_t> buses;
+    std::vector<uint32_t> stops;
+
+    if (index_.rows != 0 && viewport.Intersects(index_.extent)) {
+        std::vector<bool> visible(buses_.size(), false);
+
+        for (size_t row = index_.Row(viewport.min.lat); row <= index_.Row(viewport.max.lat); ++row) {
+            for (size_t col = index_.Col(viewport.min.lng); col <= index_.Col(viewport.max.lng); ++col) {
+                const size_t cell = row * index_.cols + col;
+
+                for (size_t bus_index : index_.buses[cell]) {
+                    visible[bus_index] = true;
+                }
+                for (uint32_t id : index_.stops[cell]) {
+                    if (viewport.Contains({stop_lats_[id], stop_lngs_[id]})) {
+                        stops.push_back(id);
+                    }
+                }
+            }
+        }
+
+        // сетка отбирает маршруты с запасом, уточняем по отрезкам
+        for (size_t i = 0; i < visible.size(); ++i) {
+            if (!visible[i]) {
+                continue;
+            }
+
+            const auto& ids = bus_stops_[i];
+            for (size_t k = 0; k < ids.size(); ++k) {
+                const uint32_t from = ids[k];
+                const uint32_t to = ids[std::min(k + 1, ids.size() - 1)];
+                if (SegmentIntersects(viewport, {stop_lats_[from], stop_lngs_[from]}, {stop_lats_[to], stop_lngs_[to]})) {
+                    buses.push_back(i);
+                    break;
+                }
+            }
+        }
+
+        // номера остановок идут в порядке вывода
+        std::sort(stops.begin(), stops.end());
+    }
+
+    // проекция по углам области
+    SphereProjector projector(viewport, settings_.width, settings_.height, settings_.padding);
+
+    RenderLayers(out, projector, buses, stops);
+}
+
+void MapRenderer::RenderLayers(std::ostream& out, const SphereProjector& projector,
+                               const std::vector<size_t>& buses, const std::vector<uint32_t>& stops) const {
+    // каждая остановка проецируется один раз
+    std::vector<svg::Point> points(stops_.size());
+    projector.Project(stop_lats_.data(), stop_lngs_.data(), points.size(), points.data());
+
+    svg::StreamWriter writer(out);
+    writer.SetPrecision(settings_.svg_precision);
+
+    if (settings_.compact_svg) {
+        writer.StyleSheet(MakeStyleSheet());
+    }
+    const Styles styles = settings_.compact_svg ? MakeCompactStyles() : MakeStyles();
+
+    const size_t threads = GetThreadCount();
+
+    // куски слоев в порядке вывода
+    std::vector<std::function<void(svg::StreamWriter&)>> jobs;
+
+    auto add_layer = [&jobs, threads](size_t count, bool splittable, auto render) {
+        const size_t chunk_count = splittable ? std::clamp<size_t>(count / MIN_CHUNK_SIZE, 1, threads) : 1;
+        const size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+
+        for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+            const size_t first = std::min(count, chunk * chunk_size);
+            const size_t last = std::min(count, first + chunk_size);
+            jobs.emplace_back([render, first, last](svg::StreamWriter& part) {
+                render(part, first, last);
+            });
+        }
+    };
+
+    // при объединении общих участков линии зависят от предыдущих маршрутов
+    add_layer(buses.size(), !settings_.merge_shared_segments,
+              [&](svg::StreamWriter& part, size_t first, size_t last) {
+        RenderBuses(part, points, styles, buses, first, last);
+    });
+    add_layer(buses.size(), true, [&](svg::StreamWriter& part, size_t first, size_t last) {
+        RenderBusesNames(part, points, styles, buses, first, last);
+    });
+    add_layer(stops.size(), true, [&](svg::StreamWriter& part, size_t first, size_t last) {
+        RenderStops(part, points, styles, stops, first, last);
+    });
+    add_layer(stops.size(), true, [&](svg::StreamWriter& part, size_t first, size_t last) {
+        RenderStopsNames(part, points, styles, stops, first, last);
+    });
+
+    // небольшую карту быстрее вывести в одном потоке
+    if (threads == 1 || buses.size() + stops.size() < MIN_CHUNK_SIZE) {
+        for (const auto& job : jobs) {
+            job(writer);
+        }
+        writer.Finish();
+        return;
+    }
+
+    // куски выводятся в свои буферы; помощников дает общий пул процесса,
+    // поэтому одновременные карты в рабочих потоках сервера не множат потоки
+    std::vector<std::string> parts(jobs.size());
+
+    thread_pool::Run(jobs.size(), threads - 1, [&](size_t i) {
+        trace::Scope scope("RenderLayers");
+        std::ostringstream stream;
+        svg::StreamWriter part(stream, false);
+        part.SetPrecision(settings_.svg_precision);
+        jobs[i](part);
+        parts[i] = stream.str();
+    });
+
+    // writer ничего не буферизует, части можно писать прямо в поток
+    for (const std::string& part : parts) {
+        out << part;
+    }
+
+    writer.Finish();
+}
+
+size_t MapRenderer::GetThreadCount() const {
+    if (settings_.threads > 0) {
+        return settings_.threads;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
 }
 
 bool MapRenderer::BusSort::operator()(const domain::Bus* lhs, const domain::Bus* rhs) const {
@@ -89,119 +518,212 @@ bool MapRenderer::StopSort::operator()(const domain::Stop* lhs, const domain::St
         rhs->name.begin(), rhs->name.end());
 }
 
-void MapRenderer::RenderBuses(SphereProjector& projector, const std::set<const domain::Bus*, BusSort>& buses_to_render) {
-    int color_index = 0;
+svg::TextStyle MapRenderer::UnderlayerStyle() const {
+    svg::TextStyle style;
+    style.SetStrokeColor(settings_.underlayer_color);
+    style.SetFillColor(settings_.underlayer_color);
+    style.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
+    style.SetStrokeWidth(settings_.underlayer_width);
+    style.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+    style.SetFontFamily("Verdana"s);
+    return style;
+}
 
-    for (const auto& bus : buses_to_render) {
-        svg::Polyline line;
+MapRenderer::Styles MapRenderer::MakeStyles() const {
+    Styles styles;
 
-        for (const domain::Stop* stop : bus->stops) {
-            auto stop_it = unique_stops_.find(stop);
-            if (stop_it != unique_stops_.end()) {
-                line.AddPoint(projector((*stop_it)->coordinates));
-            }
-        }
+    const svg::Point bus_offset{settings_.bus_label_offset[0], settings_.bus_label_offset[1]};
+    const svg::Point stop_offset{settings_.stop_label_offset[0], settings_.stop_label_offset[1]};
 
+    for (const svg::Color& color : settings_.color_palette) {
+        svg::PathStyle line;
         line.SetFillColor("none");
-        line.SetStrokeColor(settings_.color_palette[color_index % settings_.color_palette.size()]);
+        line.SetStrokeColor(color);
         line.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
         line.SetStrokeWidth(settings_.line_width);
         line.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+        styles.lines.push_back(line.Format());
+
+        svg::TextStyle label;
+        label.SetFillColor(color);
+        label.SetFontFamily("Verdana"s);
+        label.SetOffset(bus_offset);
+        label.SetFontSize(settings_.bus_label_font_size);
+        label.SetFontWeight("bold"s);
+        styles.bus_labels.push_back(label.Format());
+    }
 
-        color_index++;
+    svg::TextStyle bus_underlayer = UnderlayerStyle();
+    bus_underlayer.SetOffset(bus_offset);
+    bus_underlayer.SetFontSize(settings_.bus_label_font_size);
+    bus_underlayer.SetFontWeight("bold"s);
+    styles.bus_underlayer = bus_underlayer.Format();
+
+    svg::PathStyle stop;
+    stop.SetFillColor("white"s);
+    styles.stop = stop.Format();
+
+    svg::TextStyle stop_underlayer = UnderlayerStyle();
+    stop_underlayer.SetOffset(stop_offset);
+    stop_underlayer.SetFontSize(settings_.stop_label_font_size);
+    styles.stop_underlayer = stop_underlayer.Format();
+
+    svg::TextStyle stop_label;
+    stop_label.SetFillColor("black");
+    stop_label.SetFontFamily("Verdana"s);
+    stop_label.SetOffset(stop_offset);
+    stop_label.SetFontSize(settings_.stop_label_font_size);
+    styles.stop_label = stop_label.Format();
+
+    return styles;
+}
+
+// Классы компактного вывода:
+// u - подложка надписей, b и s - шрифты надписей маршрутов и остановок,
+// lN и cN - линия и надпись маршрута цвета N палитры, p - остановка, k - надпись остановки
+MapRenderer::Styles MapRenderer::MakeCompactStyles() const {
+    Styles styles;
 
-        document_.Add(line);
+    for (size_t i = 0; i < settings_.color_palette.size(); ++i) {
+        styles.lines.push_back(" class=\"l"s + std::to_string(i) + "\""s);
+        styles.bus_labels.push_back({" class=\"b c"s + std::to_string(i) + "\""s, {}});
     }
+
+    styles.bus_underlayer = {" class=\"u b\""s, {}};
+    styles.stop = " class=\"p\""s;
+    styles.stop_underlayer = {" class=\"u s\""s, {}};
+    styles.stop_label = {" class=\"k s\""s, {}};
+
+    // сдвиг одной строки текста атрибутами dx и dy равен сдвигу его позиции
+    styles.bus_label_shift = {settings_.bus_label_offset[0], settings_.bus_label_offset[1]};
+    styles.stop_label_shift = {settings_.stop_label_offset[0], settings_.stop_label_offset[1]};
+
+    return styles;
 }
 
-void MapRenderer::RenderBusesNames(SphereProjector& projector, const std::set<const domain::Bus*, BusSort>& buses_to_render) {
-    int color_index = 0;
+std::string MapRenderer::MakeStyleSheet() const {
+    std::ostringstream out;
 
-    for (const auto& bus : buses_to_render) {
-        std::vector<const domain::Stop*> stops;
+    // те же значения, что и в атрибутах; размеры в CSS указываются в px
+    auto stroke = [&out](double width) {
+        out << "stroke-width:"sv << width << "px;stroke-linecap:round;stroke-linejoin:round"sv;
+    };
 
-        if (bus->is_roundtrip) {
-            // кольцевой маршрут
-            stops.push_back(bus->stops.front());
-        } else {
-            // не кольцевой маршрут
-            stops.push_back(bus->stops.front());
+    for (size_t i = 0; i < settings_.color_palette.size(); ++i) {
+        out << ".l"sv << i << "{fill:none;stroke:"sv << settings_.color_palette[i] << ';';
+        stroke(settings_.line_width);
+        out << "}.c"sv << i << "{fill:"sv << settings_.color_palette[i] << '}';
+    }
 
-            if(bus->stops.front() != bus->last_stop) {
-                // конечные не совпадают
-                stops.push_back(bus->last_stop);
-            }
-        }
+    out << ".u{fill:"sv << settings_.underlayer_color << ";stroke:"sv << settings_.underlayer_color << ';';
+    stroke(settings_.underlayer_width);
+    out << '}';
 
-        for (const auto& stop : stops) {
-            svg::Text text_upper;
-            svg::Text text_bottom;
+    out << ".b{font-family:Verdana;font-size:"sv << settings_.bus_label_font_size << "px;font-weight:bold}"sv;
+    out << ".s{font-family:Verdana;font-size:"sv << settings_.stop_label_font_size << "px}"sv;
+    out << ".p{fill:white}.k{fill:black}"sv;
 
-            text_bottom.SetFontFamily("Verdana"s);
-            text_bottom.SetOffset({settings_.bus_label_offset[0], settings_.bus_label_offset[1]});
-            text_bottom.SetFontSize(settings_.bus_label_font_size);
-            text_bottom.SetFontWeight("bold"s);
-            text_bottom.SetStrokeColor(settings_.underlayer_color);
-            text_bottom.SetFillColor(settings_.underlayer_color);
-            text_bottom.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-            text_bottom.SetStrokeWidth(settings_.underlayer_width);
-            text_bottom.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-            text_bottom.SetPosition(projector(stop->coordinates));
-            text_bottom.SetData(static_cast<std::string>(bus->name));
+    return out.str();
+}
+
+void MapRenderer::RenderBuses(svg::StreamWriter& writer, const std::vector<svg::Point>& points, const Styles& styles,
+                              const std::vector<size_t>& buses, size_t first, size_t last) const {
+    const std::vector<std::string>& lines = styles.lines;
+
+    if (IsZero(settings_.simplify_tolerance) && !settings_.merge_shared_segments) {
+        for (size_t i = first; i < last; ++i) {
+            const size_t bus_index = buses[i];
+            writer.BeginPolyline();
+
+            for (uint32_t id : bus_stops_[bus_index]) {
+                writer.PolylinePoint(points[id]);
+            }
 
-            text_upper.SetFontFamily("Verdana"s);
-            text_upper.SetOffset({settings_.bus_label_offset[0], settings_.bus_label_offset[1]});
-            text_upper.SetFontSize(settings_.bus_label_font_size);
-            text_upper.SetFontWeight("bold"s);
-            text_upper.SetFillColor(settings_.color_palette[color_index % settings_.color_palette.size()]);
-            text_upper.SetPosition(projector(stop->coordinates));
-            text_upper.SetData(static_cast<std::string>(bus->name));
+            writer.EndPolyline(lines[bus_index % lines.size()]);
+        }
+        return;
+    }
 
-            document_.Add(text_bottom);
-            document_.Add(text_upper);
+    // участки, уже нарисованные предыдущими маршрутами (и этим же маршрутом)
+    std::unordered_set<uint64_t> drawn;
+    std::vector<svg::Point> line;
+
+    for (size_t k = first; k < last; ++k) {
+        const size_t bus_index = buses[k];
+        const std::string& style = lines[bus_index % lines.size()];
+        const auto& ids = bus_stops_[bus_index];
+
+        line.clear();
+        line.push_back(points[ids.front()]);
+
+        for (size_t i = 1; i < ids.size(); ++i) {
+            if (settings_.merge_shared_segments && !drawn.insert(SegmentKey(ids[i - 1], ids[i])).second) {
+                // общий участок разрывает линию
+                if (line.size() > 1) {
+                    RenderPolyline(writer, line, style);
+                }
+                line.clear();
+            }
+            line.push_back(points[ids[i]]);
         }
 
-        color_index++;
+        if (line.size() > 1 || !settings_.merge_shared_segments) {
+            RenderPolyline(writer, line, style);
+        }
     }
 }
 
-void MapRenderer::RenderStops(SphereProjector& projector) {
-    for (const domain::Stop* stop : unique_stops_) {
-        svg::Circle circle;
-
-        circle.SetRadius(settings_.stop_radius);
-        circle.SetFillColor("white"s);
-        circle.SetCenter(projector(stop->coordinates));
+void MapRenderer::RenderPolyline(svg::StreamWriter& writer, std::vector<svg::Point>& points, std::string_view style) const {
+    if (!IsZero(settings_.simplify_tolerance)) {
+        Simplify(points, settings_.simplify_tolerance);
+    }
 
-        document_.Add(circle);
+    writer.BeginPolyline();
+    for (const svg::Point& point : points) {
+        writer.PolylinePoint(point);
     }
+    writer.EndPolyline(style);
 }
 
-void MapRenderer::RenderStopsNames(SphereProjector& projector) {
-    for (const domain::Stop* stop : unique_stops_) {
-        svg::Text text_upper;
-        svg::Text text_bottom;
+void MapRenderer::RenderBusesNames(svg::StreamWriter& writer, const std::vector<svg::Point>& points, const Styles& styles,
+                                   const std::vector<size_t>& buses, size_t first, size_t last) const {
+    const svg::Point shift = styles.bus_label_shift;
+
+    for (size_t k = first; k < last; ++k) {
+        const size_t bus_index = buses[k];
+        const domain::Bus* bus = buses_[bus_index];
+        const svg::TextFormat& upper = styles.bus_labels[bus_index % styles.bus_labels.size()];
+
+        // у кольцевого маршрута и маршрута с совпадающими конечными одна надпись
+        const uint32_t ends[] = {bus_stops_[bus_index].front(), bus_last_stops_[bus_index]};
+        const size_t ends_count = (bus->is_roundtrip || ends[0] == ends[1]) ? 1 : 2;
 
-        text_bottom.SetFontFamily("Verdana"s);
-        text_bottom.SetOffset({settings_.stop_label_offset[0], settings_.stop_label_offset[1]});
-        text_bottom.SetFontSize(settings_.stop_label_font_size);
-        text_bottom.SetStrokeColor(settings_.underlayer_color);
-        text_bottom.SetFillColor(settings_.underlayer_color);
-        text_bottom.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-        text_bottom.SetStrokeWidth(settings_.underlayer_width);
-        text_bottom.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-        text_bottom.SetData(static_cast<std::string>(stop->name));
-        text_bottom.SetPosition(projector(stop->coordinates));
+        for (size_t i = 0; i < ends_count; ++i) {
+            svg::Point position = points[ends[i]];
+            position = {position.x + shift.x, position.y + shift.y};
+            writer.Text(position, bus->name, styles.bus_underlayer);
+            writer.Text(position, bus->name, upper);
+        }
+    }
+}
+
+void MapRenderer::RenderStops(svg::StreamWriter& writer, const std::vector<svg::Point>& points, const Styles& styles,
+                              const std::vector<uint32_t>& stops, size_t first, size_t last) const {
+    for (size_t i = first; i < last; ++i) {
+        const uint32_t id = stops[i];
+        writer.Circle(points[id], settings_.stop_radius, styles.stop);
+    }
+}
 
-        text_upper.SetFontFamily("Verdana"s);
-        text_upper.SetOffset({settings_.stop_label_offset[0], settings_.stop_label_offset[1]});
-        text_upper.SetFontSize(settings_.stop_label_font_size);
-        text_upper.SetFillColor("black");
-        text_upper.SetData(static_cast<std::string>(stop->name));
-        text_upper.SetPosition(projector(stop->coordinates));
+void MapRenderer::RenderStopsNames(svg::StreamWriter& writer, const std::vector<svg::Point>& points, const Styles& styles,
+                                   const std::vector<uint32_t>& stops, size_t first, size_t last) const {
+    const svg::Point shift = styles.stop_label_shift;
 
-        document_.Add(text_bottom);
-        document_.Add(text_upper);
+    for (size_t i = first; i < last; ++i) {
+        const uint32_t id = stops[i];
+        const svg::Point position = {points[id].x + shift.x, points[id].y + shift.y};
+        writer.Text(position, stops_[id]->name, styles.stop_underlayer);
+        writer.Text(position, stops_[id]->name, styles.stop_label);
     }
 }
 
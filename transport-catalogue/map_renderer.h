@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <optional>
@@ -32,9 +33,31 @@ struct RenderSettings {
     double underlayer_width;
     std::vector<svg::Color> color_palette;
 
+    // упрощение линий маршрутов (Дуглас-Пекер) с допуском в пикселях, 0 - без упрощения
+    double simplify_tolerance;
+    // участок между остановками, уже нарисованный другим маршрутом, не повторяется
+    bool merge_shared_segments;
+
+    // компактный вывод: общие стили в <style>, у элементов только класс, координаты и текст
+    bool compact_svg;
+    // число знаков после точки в координатах, -1 - 6 значащих цифр
+    int svg_precision;
+
+    // потоков для вывода слоев карты (0 - по числу ядер)
+    size_t threads;
+
     RenderSettings();
 };
 
+// Прямоугольная область карты в географических координатах
+struct Viewport {
+    geo_coord::Coordinates min{0.0, 0.0}; // минимальные широта и долгота
+    geo_coord::Coordinates max{0.0, 0.0}; // максимальные широта и долгота
+
+    bool Contains(geo_coord::Coordinates point) const;
+    bool Intersects(const Viewport& other) const;
+};
+
 inline const double EPSILON = 1e-6;
 bool IsZero(double value);
 
@@ -45,10 +68,18 @@ public:
     SphereProjector(PointInputIt points_begin, PointInputIt points_end,
                     double max_width, double max_height, double padding);
 
+    // Проекция по заранее вычисленным границам точек
+    SphereProjector(const Viewport& bounds, double max_width, double max_height, double padding);
+
     // Проецирует широту и долготу в координаты внутри SVG-изображения
     svg::Point operator()(geo_coord::Coordinates coords) const;
 
+    // Проецирует count точек, заданных раздельными массивами широт и долгот
+    void Project(const double* lats, const double* lngs, size_t count, svg::Point* out) const;
+
 private:
+    void SetBounds(const Viewport& bounds, double max_width, double max_height);
+
     double padding_;
     double min_lon_ = 0;
     double max_lat_ = 0;
@@ -62,17 +93,30 @@ public:
     void SetSettings(const RenderSettings& settings);
     const RenderSettings& GetSettings() const;
 
-    void SetBuses(const std::map<std::string_view, const domain::Bus*> buses);
+    void SetBuses(const std::map<std::string_view, const domain::Bus*>& buses);
 
-    void SetStopToBuses(const std::unordered_map<const domain::Stop*, std::unordered_set<domain::Bus*>>& stop_to_buses);
+    // запоминаются только остановки, через которые проходят маршруты
+    void SetStopToBuses(const std::pmr::unordered_map<const domain::Stop*, std::pmr::unordered_set<domain::Bus*>>& stop_to_buses);
 
-    void Render(std::ostream& out);
+    // номера остановок, их границы и пространственный индекс;
+    // строятся после SetBuses и SetStopToBuses и нужны для вывода
+    void BuildIndex();
+
+    // карта выводится потоково, без построения svg::Document
+    void Render(std::ostream& out) const;
+
+    // область, занимаемая остановками маршрутов
+    const Viewport& GetExtent() const;
+
+    // на уровне z вся карта делится на 2^z x 2^z тайлов, x растет на восток, y - на юг
+    Viewport GetTile(int z, int x, int y) const;
+
+    // выводит маршруты и остановки, попадающие в область, в масштабе этой области;
+    // цвета маршрутов совпадают с цветами на полной карте
+    void RenderViewport(std::ostream& out, const Viewport& viewport) const;
 
 private:
     RenderSettings settings_;
-    svg::Document document_;
-    std::map<std::string_view, const domain::Bus*> buses_;
-    std::unordered_map<const domain::Stop*, std::unordered_set<domain::Bus*>> stop_to_buses_;
 
     struct BusSort {
         bool operator()(const domain::Bus* lhs, const domain::Bus* rhs) const;
@@ -82,13 +126,79 @@ private:
         bool operator()(const domain::Stop* lhs, const domain::Stop* rhs) const;
     };
 
-    std::set<const domain::Stop*, StopSort> unique_stops_;
+    // непустые маршруты в порядке вывода, номер маршрута задает его цвет
+    std::vector<const domain::Bus*> buses_;
+
+    // остановки маршрутов в порядке вывода, номер остановки - ее место в векторе
+    std::vector<const domain::Stop*> stops_;
+
+    // координаты остановок по номерам, раздельными массивами для пакетной проекции
+    std::vector<double> stop_lats_;
+    std::vector<double> stop_lngs_;
+
+    // остановки маршрутов (по номерам в buses_) номерами остановок
+    std::vector<std::vector<uint32_t>> bus_stops_;
+    std::vector<uint32_t> bus_last_stops_;
+
+    // Равномерная сетка по области остановок. В ячейке хранятся номера маршрутов,
+    // отрезки которых (по описывающему прямоугольнику) задевают ячейку,
+    // и остановки, лежащие в ячейке
+    struct GridIndex {
+        Viewport extent;
+        size_t rows = 0;
+        size_t cols = 0;
+        std::vector<std::vector<size_t>> buses;
+        std::vector<std::vector<uint32_t>> stops;
+
+        size_t Row(double lat) const;
+        size_t Col(double lng) const;
+    };
+
+    GridIndex index_;
+
+    // Отформатированные один раз атрибуты элементов карты
+    struct Styles {
+        std::vector<std::string> lines;             // по цветам палитры
+        svg::TextFormat bus_underlayer;
+        std::vector<svg::TextFormat> bus_labels;    // по цветам палитры
+        std::string stop;
+        svg::TextFormat stop_underlayer;
+        svg::TextFormat stop_label;
+
+        // смещения надписей, которые не заданы атрибутами dx и dy
+        svg::Point bus_label_shift{0.0, 0.0};
+        svg::Point stop_label_shift{0.0, 0.0};
+    };
+
+    // стили атрибутами каждого элемента
+    Styles MakeStyles() const;
+    // стили классами, правила для них дает MakeStyleSheet
+    Styles MakeCompactStyles() const;
+    std::string MakeStyleSheet() const;
+
+    // buses - номера маршрутов, stops - номера остановок, по возрастанию
+    void RenderLayers(std::ostream& out, const SphereProjector& projector,
+                      const std::vector<size_t>& buses, const std::vector<uint32_t>& stops) const;
+
+    size_t GetThreadCount() const;
 
-    void RenderBuses(SphereProjector& projector, const std::set<const domain::Bus*, BusSort>& buses_to_render);
-    void RenderBusesNames(SphereProjector& projector, const std::set<const domain::Bus*, BusSort>& buses_to_render);
+    // Слои выводят элементы [first, last) списка;
+    // points - спроецированные координаты всех остановок по номерам
+    void RenderBuses(svg::StreamWriter& writer, const std::vector<svg::Point>& points, const Styles& styles,
+                     const std::vector<size_t>& buses, size_t first, size_t last) const;
+    void RenderBusesNames(svg::StreamWriter& writer, const std::vector<svg::Point>& points, const Styles& styles,
+                          const std::vector<size_t>& buses, size_t first, size_t last) const;
 
-    void RenderStops(SphereProjector& projector);
-    void RenderStopsNames(SphereProjector& projector);
+    void RenderStops(svg::StreamWriter& writer, const std::vector<svg::Point>& points, const Styles& styles,
+                     const std::vector<uint32_t>& stops, size_t first, size_t last) const;
+    void RenderStopsNames(svg::StreamWriter& writer, const std::vector<svg::Point>& points, const Styles& styles,
+                          const std::vector<uint32_t>& stops, size_t first, size_t last) const;
+
+    // стиль подложки надписей
+    svg::TextStyle UnderlayerStyle() const;
+
+    // выводит ломаную с учетом simplify_tolerance
+    void RenderPolyline(svg::StreamWriter& writer, std::vector<svg::Point>& points, std::string_view style) const;
 };
 
 template <typename PointInputIt>
@@ -101,43 +211,23 @@ SphereProjector::SphereProjector(PointInputIt points_begin, PointInputIt points_
         return;
     }
 
+    Viewport bounds;
+
     // Находим точки с минимальной и максимальной долготой
     const auto [left_it, right_it] = std::minmax_element(
         points_begin, points_end,
         [](auto lhs, auto rhs) { return lhs.lng < rhs.lng; });
-    min_lon_ = left_it->lng;
-    const double max_lon = right_it->lng;
+    bounds.min.lng = left_it->lng;
+    bounds.max.lng = right_it->lng;
 
     // Находим точки с минимальной и максимальной широтой
     const auto [bottom_it, top_it] = std::minmax_element(
         points_begin, points_end,
         [](auto lhs, auto rhs) { return lhs.lat < rhs.lat; });
-    const double min_lat = bottom_it->lat;
-    max_lat_ = top_it->lat;
-
-    // Вычисляем коэффициент масштабирования вдоль координаты x
-    std::optional<double> width_zoom;
-    if (!IsZero(max_lon - min_lon_)) {
-        width_zoom = (max_width - 2 * padding) / (max_lon - min_lon_);
-    }
-
-    // Вычисляем коэффициент масштабирования вдоль координаты y
-    std::optional<double> height_zoom;
-    if (!IsZero(max_lat_ - min_lat)) {
-        height_zoom = (max_height - 2 * padding) / (max_lat_ - min_lat);
-    }
+    bounds.min.lat = bottom_it->lat;
+    bounds.max.lat = top_it->lat;
 
-    if (width_zoom && height_zoom) {
-        // Коэффициенты масштабирования по ширине и высоте ненулевые,
-        // берём минимальный из них
-        zoom_coeff_ = std::min(*width_zoom, *height_zoom);
-    } else if (width_zoom) {
-        // Коэффициент масштабирования по ширине ненулевой, используем его
-        zoom_coeff_ = *width_zoom;
-    } else if (height_zoom) {
-        // Коэффициент масштабирования по высоте ненулевой, используем его
-        zoom_coeff_ = *height_zoom;
-    }
+    SetBounds(bounds, max_width, max_height);
 }
 
 } // namespace map_renderer
@@ -0,0 +1,182 @@
+#include "memory.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string_view>
+
+#include <sys/resource.h>
+
+#include "json.h"
+
+namespace memory {
+
+using namespace std::literals;
+
+#ifdef TRANSPORT_CATALOGUE_HEAP_COUNTER
+
+namespace {
+
+std::atomic<size_t> heap_in_use{0};
+std::atomic<size_t> heap_peak{0};
+
+// размер блока хранится перед ним, выравнивание сохраняется
+constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+
+void* Allocate(size_t size) noexcept {
+    void* block = std::malloc(size + HEADER_SIZE);
+    if (!block) {
+        return nullptr;
+    }
+    *static_cast<size_t*>(block) = size;
+
+    const size_t in_use = heap_in_use.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = heap_peak.load(std::memory_order_relaxed);
+    while (in_use > peak && !heap_peak.compare_exchange_weak(peak, in_use, std::memory_order_relaxed)) {
+    }
+
+    return static_cast<char*>(block) + HEADER_SIZE;
+}
+
+void* AllocateOrThrow(size_t size) {
+    if (void* ptr = Allocate(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void Deallocate(void* ptr) noexcept {
+    if (!ptr) {
+        return;
+    }
+    char* block = static_cast<char*>(ptr) - HEADER_SIZE;
+    heap_in_use.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+} // namespace
+
+bool IsHeapCounted() {
+    return true;
+}
+
+size_t GetHeapInUse() {
+    return heap_in_use.load(std::memory_order_relaxed);
+}
+
+size_t GetHeapPeak() {
+    return heap_peak.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool IsHeapCounted() {
+    return false;
+}
+
+size_t GetHeapInUse() {
+    return 0;
+}
+
+size_t GetHeapPeak() {
+    return 0;
+}
+
+#endif
+
+size_t GetPeakRss() {
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss); // байты
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // килобайты
+#endif
+}
+
+namespace {
+
+// структура без частей - число, с частями - словарь с total
+void PrintUsage(json::Writer& writer, const Usage& usage) {
+    writer.Key(usage.name);
+    if (usage.parts.empty()) {
+        writer.Value(static_cast<uint64_t>(usage.bytes));
+        return;
+    }
+
+    writer.StartDict().Key("total"sv).Value(static_cast<uint64_t>(usage.bytes));
+    for (const Usage& part : usage.parts) {
+        PrintUsage(writer, part);
+    }
+    writer.EndDict();
+}
+
+} // namespace
+
+void PrintReport(std::ostream& out, const std::vector<Usage>& usages) {
+    json::Writer writer(out);
+
+    writer.StartDict();
+    if (IsHeapCounted()) {
+        writer.Key("heap"sv).StartDict().
+            Key("in_use"sv).Value(static_cast<uint64_t>(GetHeapInUse())).
+            Key("peak"sv).Value(static_cast<uint64_t>(GetHeapPeak())).
+            EndDict();
+    }
+    writer.Key("peak_rss"sv).Value(static_cast<uint64_t>(GetPeakRss()));
+
+    writer.Key("structures"sv).StartDict();
+    for (const Usage& usage : usages) {
+        PrintUsage(writer, usage);
+    }
+    writer.EndDict().EndDict();
+    out << '\n';
+}
+
+} // namespace memory
+
+#ifdef TRANSPORT_CATALOGUE_HEAP_COUNTER
+
+void* operator new(std::size_t size) {
+    return memory::AllocateOrThrow(size);
+}
+
+void* operator new[](std::size_t size) {
+    return memory::AllocateOrThrow(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return memory::Allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return memory::Allocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    memory::Deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    memory::Deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    memory::Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    memory::Deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    memory::Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    memory::Deallocate(ptr);
+}
+
+#endif
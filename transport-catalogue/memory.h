@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace memory {
+
+// Оценки памяти в куче под содержимое контейнеров: без самого объекта
+// контейнера и накладных расходов распределителя
+
+inline size_t StringBytes(const std::string& str) {
+    // короткая строка хранится внутри объекта
+    const char* data = str.data();
+    const char* object = reinterpret_cast<const char*>(&str);
+    if (data >= object && data < object + sizeof(str)) {
+        return 0;
+    }
+    return str.capacity() + 1;
+}
+
+template <typename T, typename Allocator>
+size_t VectorBytes(const std::vector<T, Allocator>& vector) {
+    return vector.capacity() * sizeof(T);
+}
+
+template <typename T, typename Allocator>
+size_t DequeBytes(const std::deque<T, Allocator>& deque) {
+    // блоки по 512 байт, как в libstdc++, и массив указателей на них
+    constexpr size_t block = sizeof(T) < 512 ? 512 / sizeof(T) * sizeof(T) : sizeof(T);
+    const size_t blocks = deque.size() * sizeof(T) / block + 1;
+    return blocks * block + std::max<size_t>(8, blocks + 2) * sizeof(void*);
+}
+
+// unordered_map и unordered_set: корзины и узлы со ссылкой на следующий и хэшем
+template <typename Container>
+size_t HashBytes(const Container& container) {
+    const size_t node = sizeof(void*) + sizeof(typename Container::value_type) + sizeof(size_t);
+    return container.bucket_count() * sizeof(void*) + container.size() * node;
+}
+
+// Память структуры: всего и по частям
+struct Usage {
+    std::string name;
+    size_t bytes = 0; // вместе с частями
+    std::vector<Usage> parts;
+
+    explicit Usage(std::string name, size_t bytes = 0)
+        : name(std::move(name))
+        , bytes(bytes) {
+    }
+
+    Usage& Add(Usage part) {
+        bytes += part.bytes;
+        parts.push_back(std::move(part));
+        return *this;
+    }
+
+    Usage& Add(std::string part_name, size_t part_bytes) {
+        return Add(Usage(std::move(part_name), part_bytes));
+    }
+};
+
+// Подсчет кучи заменой глобальных operator new и delete, только в сборке
+// с TRANSPORT_CATALOGUE_HEAP_COUNTER (выровненные new не считаются)
+bool IsHeapCounted();
+size_t GetHeapInUse();
+size_t GetHeapPeak();
+
+// пиковый размер резидентной памяти процесса, байты (0, если неизвестен)
+size_t GetPeakRss();
+
+// JSON-отчет: оценки структур, куча и пиковая резидентная память
+void PrintReport(std::ostream& out, const std::vector<Usage>& usages);
+
+} // namespace memory
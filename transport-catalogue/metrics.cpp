@@ -0,0 +1,93 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace metrics {
+
+namespace {
+
+int GetHighestBit(uint64_t value) {
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+}
+
+} // namespace
+
+void Histogram::Record(uint64_t value) {
+    value = std::min(value, MAX_VALUE);
+
+    buckets_[GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t Histogram::GetCount() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::GetMax() const {
+    return max_.load(std::memory_order_relaxed);
+}
+
+double Histogram::GetMean() const {
+    const uint64_t count = GetCount();
+    return count ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / count : 0.0;
+}
+
+uint64_t Histogram::GetQuantile(double quantile) const {
+    // корзины читаются по одной, поэтому считаем записи заново, а не берем count_
+    std::array<uint64_t, BUCKET_COUNT> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    // номер записи с нужным рангом, начиная с 1
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * total)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(GetUpperBound(i), GetMax());
+        }
+    }
+    return GetMax();
+}
+
+size_t Histogram::GetBucket(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return value;
+    }
+    // старшие SUB_BUCKET_BITS бит значения: номер степени двойки и корзина в ней
+    const int shift = GetHighestBit(value) - SUB_BUCKET_BITS + 1;
+    return SUB_BUCKET_COUNT + (shift - 1) * HALF_COUNT + ((value >> shift) - HALF_COUNT);
+}
+
+uint64_t Histogram::GetUpperBound(size_t bucket) {
+    if (bucket < SUB_BUCKET_COUNT) {
+        return bucket;
+    }
+    const size_t offset = bucket - SUB_BUCKET_COUNT;
+    const int shift = static_cast<int>(offset / HALF_COUNT) + 1;
+    const uint64_t mantissa = offset % HALF_COUNT + HALF_COUNT;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+Metrics& Get() {
+    static Metrics metrics;
+    return metrics;
+}
+
+} // namespace metrics
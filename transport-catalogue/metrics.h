@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace metrics {
+
+// Гистограмма с логарифмически-линейными корзинами (как HDR Histogram):
+// значения до 128 хранятся точно, дальше в каждой степени двойки 64 корзины,
+// так что квантиль завышается не больше чем на 1/64. Запись без блокировок,
+// читать можно одновременно с записью
+class Histogram {
+public:
+    void Record(uint64_t value);
+
+    uint64_t GetCount() const;
+    uint64_t GetMax() const;
+    double GetMean() const;
+
+    // наименьшее значение, не меньше которого доля quantile записей (верхняя граница корзины)
+    uint64_t GetQuantile(double quantile) const;
+
+private:
+    static constexpr int SUB_BUCKET_BITS = 7;
+    static constexpr uint64_t SUB_BUCKET_COUNT = uint64_t{1} << SUB_BUCKET_BITS;
+    static constexpr uint64_t HALF_COUNT = SUB_BUCKET_COUNT / 2;
+    // значения больше 2^48 (трое суток в наносекундах) записываются как 2^48 - 1
+    static constexpr int VALUE_BITS = 48;
+    static constexpr uint64_t MAX_VALUE = (uint64_t{1} << VALUE_BITS) - 1;
+    static constexpr size_t BUCKET_COUNT = SUB_BUCKET_COUNT + (VALUE_BITS - SUB_BUCKET_BITS) * HALF_COUNT;
+
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+
+    static size_t GetBucket(uint64_t value);
+    static uint64_t GetUpperBound(size_t bucket);
+};
+
+using Counter = std::atomic<uint64_t>;
+
+inline void Add(Counter& counter, uint64_t value = 1) {
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+inline uint64_t Read(const Counter& counter) {
+    return counter.load(std::memory_order_relaxed);
+}
+
+// Метрики процесса; переживают перезагрузку базы
+struct Metrics {
+    // время ответа на запросы по типам, наносекунды
+    Histogram stop_latency;
+    Histogram bus_latency;
+    Histogram map_latency;
+    Histogram route_latency;
+
+    Counter errors; // ответы с error_message
+    Counter response_hits; // ответы Stop и Bus из готовых
+    Counter response_misses;
+    Counter map_hits; // карты из кэша (вся карта и области)
+    Counter map_misses;
+    Counter map_bytes; // выведено байт карт
+    Counter route_edges; // ребер графа в найденных маршрутах
+};
+
+Metrics& Get();
+
+} // namespace metrics
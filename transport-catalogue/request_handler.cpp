@@ -9,14 +9,25 @@ RequestHandler::RequestHandler(const transport_catalogue::TransportCatalogue& ca
 
 }
 
-void RequestHandler::RenderMap(std::ostream& out) const {
+void RequestHandler::PrepareRender() {
     RenderSetBuses();
     RenderSetStopToBuses();
+    renderer_.BuildIndex();
+}
 
+void RequestHandler::RenderMap(std::ostream& out) const {
     renderer_.Render(out);
 }
 
-void RequestHandler::RenderSetBuses() const {
+void RequestHandler::RenderViewport(std::ostream& out, const map_renderer::Viewport& viewport) const {
+    renderer_.RenderViewport(out, viewport);
+}
+
+map_renderer::Viewport RequestHandler::GetTile(int z, int x, int y) const {
+    return renderer_.GetTile(z, x, y);
+}
+
+void RequestHandler::RenderSetBuses() {
     std::map<std::string_view, const domain::Bus*> buses;
     for (const auto& [name, bus] : catalogue_.getBuses()) {
         buses[name] = bus;
@@ -24,7 +35,7 @@ void RequestHandler::RenderSetBuses() const {
     renderer_.SetBuses(buses);
 }
 
-void RequestHandler::RenderSetStopToBuses() const {
+void RequestHandler::RenderSetStopToBuses() {
     renderer_.SetStopToBuses(catalogue_.getStopToBuses());
 }
 
@@ -15,17 +15,25 @@ public:
                             map_renderer::MapRenderer& renderer,
                             transport_router::TransportRouter& router);
 
+    // передает визуализатору маршруты, остановки и строит индекс;
+    // вызывается один раз до любого вывода карты, дальше данные только читаются
+    void PrepareRender();
+
     void RenderMap(std::ostream& out) const;
 
+    // область карты и тайл z/x/y в географических координатах
+    void RenderViewport(std::ostream& out, const map_renderer::Viewport& viewport) const;
+    map_renderer::Viewport GetTile(int z, int x, int y) const;
+
 private:
     // RequestHandler использует агрегацию объектов "Транспортный Справочник" и "Визуализатор Карты"
     const transport_catalogue::TransportCatalogue& catalogue_;
     map_renderer::MapRenderer& renderer_;
     transport_router::TransportRouter& router_;
 
-    void RenderSetBuses() const;
+    void RenderSetBuses();
 
-    void RenderSetStopToBuses() const;
+    void RenderSetStopToBuses();
 };
 
 } // namespace request_handler
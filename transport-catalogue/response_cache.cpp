@@ -0,0 +1,131 @@
+#include <algorithm>
+
+#include "response_cache.h"
+
+namespace response_cache {
+
+void ResponseCache::SetStop(std::string_view name, Fragment fragment) {
+    auto [it, inserted] = stops_.insert_or_assign(static_cast<std::string>(name), std::move(fragment));
+
+    // ключи и значения узлов unordered_map не перемещаются при рехешировании
+    stop_index_[it->first] = &it->second;
+}
+
+void ResponseCache::SetBus(std::string_view name, Fragment fragment) {
+    auto [it, inserted] = buses_.insert_or_assign(static_cast<std::string>(name), std::move(fragment));
+
+    // ключи и значения узлов unordered_map не перемещаются при рехешировании
+    bus_index_[it->first] = &it->second;
+}
+
+const Fragment* ResponseCache::FindStop(std::string_view name) const {
+    auto it = stop_index_.find(name);
+    return (it != stop_index_.end()) ? it->second : nullptr;
+}
+
+const Fragment* ResponseCache::FindBus(std::string_view name) const {
+    auto it = bus_index_.find(name);
+    return (it != bus_index_.end()) ? it->second : nullptr;
+}
+
+const std::unordered_map<std::string, Fragment>& ResponseCache::GetStops() const {
+    return stops_;
+}
+
+const std::unordered_map<std::string, Fragment>& ResponseCache::GetBuses() const {
+    return buses_;
+}
+
+void ResponseCache::SetMap(std::string map) {
+    map_ = std::move(map);
+}
+
+const std::string* ResponseCache::GetMap() const {
+    return map_ ? &*map_ : nullptr;
+}
+
+void ResponseCache::SetCompressedMap(std::string map) {
+    compressed_map_ = std::move(map);
+}
+
+const std::string* ResponseCache::GetCompressedMap() const {
+    return compressed_map_ ? &*compressed_map_ : nullptr;
+}
+
+bool ResponseCache::IsEmpty() const {
+    return stops_.empty() && buses_.empty() && !map_ && !compressed_map_;
+}
+
+namespace {
+
+size_t FragmentsBytes(const std::unordered_map<std::string, Fragment>& fragments,
+                      const std::unordered_map<std::string_view, const Fragment*>& index) {
+    size_t bytes = memory::HashBytes(fragments) + memory::HashBytes(index);
+    for (const auto& [name, fragment] : fragments) {
+        bytes += memory::StringBytes(name) + memory::StringBytes(fragment.head) + memory::StringBytes(fragment.tail);
+    }
+    return bytes;
+}
+
+} // namespace
+
+memory::Usage ResponseCache::MemoryUsage() const {
+    memory::Usage usage("responses");
+
+    usage.Add("stops", FragmentsBytes(stops_, stop_index_));
+    usage.Add("buses", FragmentsBytes(buses_, bus_index_));
+    usage.Add("maps", (map_ ? memory::StringBytes(*map_) : 0)
+                    + (compressed_map_ ? memory::StringBytes(*compressed_map_) : 0));
+
+    return usage;
+}
+
+ViewportCache::ViewportCache(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)) {
+}
+
+ViewportCache::Map ViewportCache::Find(std::string_view key) {
+    std::lock_guard lock(mutex_);
+
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return nullptr;
+    }
+
+    // узлы списка не перемещаются, ключи индекса остаются действительными
+    items_.splice(items_.begin(), items_, it->second);
+    return it->second->second;
+}
+
+ViewportCache::Map ViewportCache::Put(std::string key, std::string map) {
+    Map value = std::make_shared<const std::string>(std::move(map));
+
+    std::lock_guard lock(mutex_);
+
+    if (auto it = index_.find(key); it != index_.end()) {
+        items_.splice(items_.begin(), items_, it->second);
+        return it->second->second;
+    }
+
+    if (items_.size() == capacity_) {
+        index_.erase(items_.back().first);
+        items_.pop_back();
+    }
+
+    items_.emplace_front(std::move(key), std::move(value));
+    index_.emplace(items_.front().first, items_.begin());
+    return items_.front().second;
+}
+
+size_t ViewportCache::MemoryUsage() const {
+    std::lock_guard lock(mutex_);
+
+    // узел списка: две ссылки и пара ключ - карта
+    size_t bytes = memory::HashBytes(index_) + items_.size() * (2 * sizeof(void*) + sizeof(decltype(items_)::value_type));
+    for (const auto& [key, map] : items_) {
+        bytes += memory::StringBytes(key) + sizeof(std::string) + memory::StringBytes(*map);
+    }
+    return bytes;
+}
+
+} // namespace response_cache
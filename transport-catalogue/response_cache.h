@@ -0,0 +1,87 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "memory.h"
+
+namespace response_cache {
+
+// Готовый к выводу ответ без request_id: head + request_id + tail
+struct Fragment {
+    std::string head;
+    std::string tail;
+};
+
+// Заранее сформированные (в компактном виде) ответы на запросы Stop и Bus
+class ResponseCache {
+public:
+    ResponseCache() = default;
+
+    void SetStop(std::string_view name, Fragment fragment);
+    void SetBus(std::string_view name, Fragment fragment);
+
+    // nullptr, если ответа нет
+    const Fragment* FindStop(std::string_view name) const;
+    const Fragment* FindBus(std::string_view name) const;
+
+    const std::unordered_map<std::string, Fragment>& GetStops() const;
+    const std::unordered_map<std::string, Fragment>& GetBuses() const;
+
+    // карта в виде готовой JSON-строки (в кавычках, с экранированием)
+    void SetMap(std::string map);
+    const std::string* GetMap() const; // nullptr, если карты нет
+
+    // карта, сжатая gzip и закодированная base64, тоже готовой JSON-строкой
+    void SetCompressedMap(std::string map);
+    const std::string* GetCompressedMap() const; // nullptr, если карты нет
+
+    bool IsEmpty() const;
+
+    // оценка памяти в куче: ответы Stop, Bus и карты
+    memory::Usage MemoryUsage() const;
+
+private:
+    std::unordered_map<std::string, Fragment> stops_;
+    std::unordered_map<std::string, Fragment> buses_;
+
+    std::unordered_map<std::string_view, const Fragment*> stop_index_;
+    std::unordered_map<std::string_view, const Fragment*> bus_index_;
+
+    std::optional<std::string> map_;
+    std::optional<std::string> compressed_map_;
+};
+
+// Карты областей в виде готовых JSON-строк. Хранится не больше capacity карт,
+// при переполнении вытесняется та, к которой дольше всего не обращались.
+// Можно использовать из нескольких потоков: вытесненная карта живет,
+// пока ее выводит тот, кто ее получил
+class ViewportCache {
+public:
+    using Map = std::shared_ptr<const std::string>;
+
+    explicit ViewportCache(size_t capacity = 256);
+
+    // nullptr, если карты нет; найденная карта становится последней использованной
+    Map Find(std::string_view key);
+    // если карту с этим ключом уже положил другой поток, возвращается она
+    Map Put(std::string key, std::string map);
+
+    // память в куче под хранимые карты и ключи, байты
+    size_t MemoryUsage() const;
+
+private:
+    size_t capacity_;
+    mutable std::mutex mutex_;
+
+    // в начале списка - последние использованные
+    std::list<std::pair<std::string, Map>> items_;
+    std::unordered_map<std::string_view, std::list<std::pair<std::string, Map>>::iterator> index_;
+};
+
+} // namespace response_cache
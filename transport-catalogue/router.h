@@ -1,6 +1,7 @@
 #pragma once
 
 #include "graph.h"
+#include "memory.h"
 
 #include <algorithm>
 #include <cassert>
@@ -29,6 +30,9 @@ public:
 
     std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
 
+    // память в куче под таблицу путей между всеми парами вершин (V^2), байты
+    size_t MemoryUsage() const;
+
 private:
     struct RouteInternalData {
         Weight weight;
@@ -114,4 +118,13 @@ std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(Ver
     return RouteInfo{weight, std::move(edges)};
 }
 
+template <typename Weight>
+size_t Router<Weight>::MemoryUsage() const {
+    size_t bytes = memory::VectorBytes(routes_internal_data_);
+    for (const auto& routes : routes_internal_data_) {
+        bytes += memory::VectorBytes(routes);
+    }
+    return bytes;
+}
+
 }  // namespace graph
\ No newline at end of file
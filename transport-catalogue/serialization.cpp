@@ -1,18 +1,87 @@
 #include "serialization.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <future>
 #include <sstream>
+#include <thread>
+
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+
+#include "trace.h"
 
 using namespace std;
 
 namespace serialization {
 
+namespace {
+
+// координаты в компактном виде хранятся в микроградусах
+constexpr double COORD_SCALE = 1e6;
+
+// первые байты gzip потока
+constexpr char GZIP_MAGIC[] = {'\x1f', '\x8b'};
+
+// меньше этого числа элементов на поток делить работу невыгодно
+constexpr size_t MIN_CHUNK_SIZE = 1024;
+
+// делит интервал [0, count) на куски и обрабатывает их параллельно,
+// func(chunk, begin, end) вызывается по разу на каждый кусок
+template <typename Func>
+size_t ParallelChunks(size_t count, size_t threads, Func func) {
+    const size_t chunk_count = clamp<size_t>(count / MIN_CHUNK_SIZE, 1, max<size_t>(threads, 1));
+    const size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+
+    vector<future<void>> futures;
+    futures.reserve(chunk_count - 1);
+
+    auto traced = [&func](size_t chunk, size_t begin, size_t end) {
+        trace::Scope scope("Chunk");
+        func(chunk, begin, end);
+    };
+
+    for (size_t chunk = 1; chunk < chunk_count; ++chunk) {
+        const size_t begin = min(count, chunk * chunk_size);
+        const size_t end = min(count, begin + chunk_size);
+        futures.push_back(async(launch::async, traced, chunk, begin, end));
+    }
+
+    // первый кусок обрабатываем в текущем потоке
+    traced(0, 0, min(count, chunk_size));
+
+    // get() пробрасывает исключения из рабочих потоков
+    for (auto& f : futures) {
+        f.get();
+    }
+
+    return chunk_count;
+}
+
+// чередует биты x и y (кривая Мортона): близкие точки получают близкие ключи
+uint64_t MortonKey(uint32_t x, uint32_t y) {
+    auto spread = [](uint64_t v) {
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+        v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+        v = (v | (v << 2)) & 0x3333333333333333ull;
+        v = (v | (v << 1)) & 0x5555555555555555ull;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+} // namespace
+
 Serializator::Serializator(transport_catalogue::TransportCatalogue& catalogue,
                            map_renderer::MapRenderer& renderer,
-                           transport_router::TransportRouter& router) :
+                           transport_router::TransportRouter& router,
+                           response_cache::ResponseCache& responses) :
                            catalogue_(catalogue),
                            renderer_(renderer),
-                           router_(router) {
+                           router_(router),
+                           responses_(responses) {
 
 }
 
@@ -20,33 +89,102 @@ void Serializator::SetSettings(const SerializatorSettings& settings) {
     settings_ = settings;
 }
 
+const SerializatorSettings& Serializator::GetSettings() const {
+    return settings_;
+}
+
+size_t Serializator::GetThreadCount() const {
+    if (settings_.threads > 0) {
+        return settings_.threads;
+    }
+    return max<size_t>(thread::hardware_concurrency(), 1);
+}
+
+void Serializator::RoundCoordinates() {
+    if (!settings_.compact) {
+        return;
+    }
+
+    trace::Scope scope("RoundCoordinates");
+    for (const auto& [name, stop] : catalogue_.getStops()) {
+        const geo_coord::Coordinates coordinates{llround(stop->coordinates.lat * COORD_SCALE) / COORD_SCALE,
+                                                 llround(stop->coordinates.lng * COORD_SCALE) / COORD_SCALE};
+        catalogue_.setCoordinates(name, coordinates);
+    }
+}
+
 void Serializator::Serialize() {
+    trace::Scope scope("Serialize");
+
     ofstream out_file(settings_.path, ios::binary);
 
     // подготовка к записи
-    WriteStops();
+    if (settings_.compact) {
+        WriteCompactStops();
+    } else {
+        WriteStops();
+    }
     WriteBuses();
     WriteRender();
     WriteRouter();
+    WriteResponses();
 
     // пишем в файл
-    pr_catalogue_.SerializeToOstream(&out_file);
+    trace::Scope write_scope("WriteFile");
+    if (settings_.compression == Compression::GZIP) {
+        google::protobuf::io::OstreamOutputStream out_stream(&out_file);
+        google::protobuf::io::GzipOutputStream gzip_stream(&out_stream);
+        pr_catalogue_.SerializeToZeroCopyStream(&gzip_stream);
+        gzip_stream.Close();
+    } else {
+        pr_catalogue_.SerializeToOstream(&out_file);
+    }
 }
 
-void Serializator::Deserialize() {
+bool Serializator::Deserialize() {
+    trace::Scope scope("Deserialize");
+
     ifstream in_file(settings_.path, ios::binary);
 
+    // сжатый файл узнаем по сигнатуре gzip
+    char magic[sizeof(GZIP_MAGIC)] = {};
+    in_file.read(magic, sizeof(magic));
+    const bool is_gzip = in_file.gcount() == sizeof(magic) && equal(begin(magic), end(magic), begin(GZIP_MAGIC));
+    in_file.clear();
+    in_file.seekg(0);
+
     // читаем из файла
-    pr_catalogue_.ParseFromIstream(&in_file);
+    bool parsed = false;
+    {
+        trace::Scope scope("ReadFile");
+        if (is_gzip) {
+            google::protobuf::io::IstreamInputStream in_stream(&in_file);
+            google::protobuf::io::GzipInputStream gzip_stream(&in_stream);
+            parsed = pr_catalogue_.ParseFromZeroCopyStream(&gzip_stream);
+        } else {
+            parsed = pr_catalogue_.ParseFromIstream(&in_file);
+        }
+    }
 
     // разбираем что прочитали
-    ReadStops();
-    ReadBuses();
-    ReadRender();
-    ReadRouter();
+    {
+        trace::Scope scope("ReadCatalogue");
+        if (pr_catalogue_.has_compact_stops()) {
+            ReadCompactStops();
+        } else {
+            ReadStops();
+        }
+        ReadBuses();
+        ReadRender();
+        ReadRouter();
+        ReadResponses();
+    }
 
     // строим маршрут
     router_.CalcRoute();
+
+    // ошибка чтения не прерывает загрузку, решение за вызывающим
+    return parsed;
 }
 
 // --> serialization
@@ -62,7 +200,7 @@ pr_transport_catalogue::Stop Serializator::StopToPrStop(const domain::Stop& stop
     pr_coordinates.set_lng(stop.coordinates.lng);
     *pr_stop.mutable_coordinates() = move(pr_coordinates);
 
-    unordered_map<string, vector<pair<int, string>>> map_stop_dist = catalogue_.getStopDistance();
+    const auto& map_stop_dist = catalogue_.getStopDistance();
     auto it = map_stop_dist.find(static_cast<string>(stop.name));
     if (it != map_stop_dist.end()) {
         for (const auto& [dist, stop_to] : it->second) {
@@ -176,6 +314,14 @@ pr_map_renderer::RenderSettings Serializator::RenderToPrRender(const map_rendere
 
     PaletteColorToPrColor(pr_renderer_settings, settings.color_palette);
 
+    pr_renderer_settings.set_simplify_tolerance(settings.simplify_tolerance);
+    pr_renderer_settings.set_merge_shared_segments(settings.merge_shared_segments);
+    pr_renderer_settings.set_compact_svg(settings.compact_svg);
+    pr_renderer_settings.set_threads(static_cast<uint32_t>(settings.threads));
+    if (settings.svg_precision >= 0) {
+        pr_renderer_settings.mutable_svg_precision()->set_value(settings.svg_precision);
+    }
+
     return pr_renderer_settings;
 }
 
@@ -196,6 +342,79 @@ void Serializator::WriteStops() {
     }
 }
 
+// берем все остановки из каталога и кладем в файл по столбцам:
+// координаты - дельтами в микроградусах, расстояния - индексами остановок
+void Serializator::WriteCompactStops() {
+    pr_transport_catalogue::CompactStops& pr_stops = *pr_catalogue_.mutable_compact_stops();
+
+    // остановки в микроградусах
+    struct CompactStop {
+        string_view name;
+        int64_t lat;
+        int64_t lng;
+        uint64_t key;
+    };
+
+    vector<CompactStop> stops;
+    stops.reserve(catalogue_.getStops().size());
+    for (const auto& [name, stop] : catalogue_.getStops()) {
+        const int64_t lat = llround(stop->coordinates.lat * COORD_SCALE);
+        const int64_t lng = llround(stop->coordinates.lng * COORD_SCALE);
+        // сдвиг в неотрицательные значения, которые укладываются в 32 бита;
+        // координаты вне диапазона только ухудшают порядок, дельты точны
+        const uint64_t key = MortonKey(static_cast<uint32_t>(lng + llround(180 * COORD_SCALE)),
+                                       static_cast<uint32_t>(lat + llround(90 * COORD_SCALE)));
+        stops.push_back({name, lat, lng, key});
+    }
+
+    // порядок записи - по кривой Мортона: соседние остановки рядом, дельты
+    // координат короткие; при равных ключах - по имени. Файл не зависит
+    // от порядка обхода хэш-таблицы
+    pr_stops.set_order(pr_transport_catalogue::CompactStops::MORTON);
+    sort(stops.begin(), stops.end(), [](const CompactStop& lhs, const CompactStop& rhs) {
+        return tie(lhs.key, lhs.name) < tie(rhs.key, rhs.name);
+    });
+
+    // индексы остановок в порядке записи
+    unordered_map<string_view, uint32_t> stop_index;
+    stop_index.reserve(stops.size());
+
+    int64_t prev_lat = 0;
+    int64_t prev_lng = 0;
+
+    for (const CompactStop& stop : stops) {
+        stop_index.emplace(stop.name, static_cast<uint32_t>(stop_index.size()));
+        pr_stops.add_names(static_cast<string>(stop.name));
+
+        pr_stops.add_coordinates(stop.lat - prev_lat);
+        pr_stops.add_coordinates(stop.lng - prev_lng);
+        prev_lat = stop.lat;
+        prev_lng = stop.lng;
+    }
+
+    const auto& map_stop_dist = catalogue_.getStopDistance();
+
+    for (const CompactStop& stop : stops) {
+        uint32_t count = 0;
+
+        auto it = map_stop_dist.find(static_cast<string>(stop.name));
+        if (it != map_stop_dist.end()) {
+            for (const auto& [dist, stop_to] : it->second) {
+                auto to_it = stop_index.find(stop_to);
+                if (to_it == stop_index.end()) {
+                    // неизвестные остановки при чтении все равно отбрасываются
+                    continue;
+                }
+                pr_stops.add_distance_stops(to_it->second);
+                pr_stops.add_distances(dist);
+                ++count;
+            }
+        }
+
+        pr_stops.add_distance_counts(count);
+    }
+}
+
 // берем все автобусы из каталога и кладем в файл
 void Serializator::WriteBuses() {
     for (const auto [name, bus] : catalogue_.getBuses()) {
@@ -213,6 +432,39 @@ void Serializator::WriteRouter() {
     *pr_catalogue_.mutable_router_settings() = move(RouterToPrRouter(router_.GetSettings()));
 }
 
+// берем готовые ответы и кладем в файл
+void Serializator::WriteResponses() {
+    if (responses_.IsEmpty()) {
+        return;
+    }
+
+    pr_response_cache::ResponseCache& pr_responses = *pr_catalogue_.mutable_responses();
+
+    auto to_pr_fragment = [](const string& name, const response_cache::Fragment& fragment) {
+        pr_response_cache::Fragment pr_fragment;
+        pr_fragment.set_name(name);
+        pr_fragment.set_head(fragment.head);
+        pr_fragment.set_tail(fragment.tail);
+        return pr_fragment;
+    };
+
+    for (const auto& [name, fragment] : responses_.GetStops()) {
+        *pr_responses.add_stops() = to_pr_fragment(name, fragment);
+    }
+
+    for (const auto& [name, fragment] : responses_.GetBuses()) {
+        *pr_responses.add_buses() = to_pr_fragment(name, fragment);
+    }
+
+    if (const string* map = responses_.GetMap()) {
+        pr_responses.set_map(*map);
+    }
+
+    if (const string* map = responses_.GetCompressedMap()) {
+        pr_responses.set_compressed_map(*map);
+    }
+}
+
 // <-- serialization
 
 // --> deserialization
@@ -229,48 +481,29 @@ void Serializator::PrStopToStop(const pr_transport_catalogue::Stop& pr_stop) {
 }
 
 // конвертация прото автобуса в автобус каталога
-void Serializator::PrBusToBus(const pr_transport_catalogue::Bus& pr_bus) {
-    string name = pr_bus.name();
-    string last_stop = pr_bus.last_stop();
-    bool is_roundtrip = pr_bus.is_roundtrip();
+// (только чтение каталога, можно вызывать из нескольких потоков)
+Serializator::BusEntry Serializator::PrBusToBus(const pr_transport_catalogue::Bus& pr_bus) const {
+    BusEntry entry;
 
-    vector<string> stops;
-    size_t sz = pr_bus.bus_stops_size();
-    stops.reserve(sz);
+    const int sz = pr_bus.bus_stops_size();
+    entry.stops.reserve(sz);
 
     for (int i = 0; i < sz; ++i) {
-        stops.push_back(pr_bus.bus_stops(i));
-    }
-
-    // добавляем маршруты
-    catalogue_.addBus(name, last_stop, is_roundtrip, stops);
-
-    // формируем информацию о маршруте
-    transport_catalogue::BusInfo info;
-
-    const domain::Bus* bus = catalogue_.findBus(name);
-
-    unordered_set<string_view> stop_storage;
-
-    info.stop_number = static_cast<int>(bus->stops.size());
-
-    double geo_distance = 0;
-
-    const domain::Stop* previous = nullptr;
-    for(const domain::Stop* current : bus->stops) {
-        stop_storage.emplace(current->name);
-        if(previous) {
-            info.distance += catalogue_.getDistance(previous, current);
-            geo_distance += ComputeDistance(previous->coordinates, current->coordinates);
+        const string& stop_name = pr_bus.bus_stops(i);
+        const domain::Stop* stop = catalogue_.findStop(stop_name);
+        if (!stop) {
+            throw invalid_argument(__func__ + " invalid stop pointer"s);
+        }
+        if (stop_name == pr_bus.last_stop()) {
+            entry.last_stop = stop;
         }
-        previous = current;
+        entry.stops.push_back(stop);
     }
 
-    info.unique_stop_number = static_cast<int>(stop_storage.size());
-
-    info.curvature = info.distance/geo_distance;
+    // формируем информацию о маршруте
+    entry.info = catalogue_.calcBusInfo(entry.stops);
 
-    catalogue_.addBusInfo(bus, info);
+    return entry;
 }
 
 svg::Color Serializator::PrColorToColor(const pr_svg::Color& pr_color) {
@@ -324,6 +557,14 @@ void Serializator::PrRenderToRender(const pr_map_renderer::RenderSettings& pr_se
         settings.color_palette.emplace_back(PrColorToColor(pr_settings.color_palette(i)));
     }
 
+    settings.simplify_tolerance = pr_settings.simplify_tolerance();
+    settings.merge_shared_segments = pr_settings.merge_shared_segments();
+    settings.compact_svg = pr_settings.compact_svg();
+    settings.threads = pr_settings.threads();
+    if (pr_settings.has_svg_precision()) {
+        settings.svg_precision = pr_settings.svg_precision().value();
+    }
+
     renderer_.SetSettings(settings);
 }
 
@@ -339,31 +580,111 @@ void Serializator::PrRouterToRouter(const pr_transport_router::RouterSettings& p
 
 // берем все прото остановки и кладем в каталог
 void Serializator::ReadStops() {
+    catalogue_.reserve(pr_catalogue_.stops_size(), pr_catalogue_.buses_size());
+
     for (int i = 0; i < pr_catalogue_.stops_size(); ++i) {
         // добавляем в каталог остановки
         PrStopToStop(pr_catalogue_.stops(i));
     }
 
-    for (int i = 0; i < pr_catalogue_.stops_size(); ++i) {
-        const pr_transport_catalogue::Stop& pr_stop = pr_catalogue_.stops(i);
+    // имена остановок разрешаем параллельно, каждый поток пишет в свой кусок
+    vector<vector<DistanceEntry>> chunks(GetThreadCount());
 
-        for (int j = 0; j < pr_stop.distances_size(); ++j) {
-            // добавляем в каталог расстояния между остановками
-            const pr_transport_catalogue::Distance& pr_distance = pr_stop.distances(j);
+    const size_t chunk_count = ParallelChunks(pr_catalogue_.stops_size(), chunks.size(),
+                                              [this, &chunks](size_t chunk, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const pr_transport_catalogue::Stop& pr_stop = pr_catalogue_.stops(static_cast<int>(i));
+            const domain::Stop* from = catalogue_.findStop(pr_stop.name());
 
-            string name = pr_stop.name();
-            int dist = pr_distance.dist();
-            string stop_to = pr_distance.stop_to();
+            for (const pr_transport_catalogue::Distance& pr_distance : pr_stop.distances()) {
+                chunks[chunk].push_back({from, catalogue_.findStop(pr_distance.stop_to()),
+                                         static_cast<int>(pr_distance.dist())});
+            }
+        }
+    });
 
-            catalogue_.setDistance(name, stop_to, dist);
+    // добавляем в каталог расстояния между остановками в исходном порядке
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        for (const DistanceEntry& entry : chunks[chunk]) {
+            catalogue_.setDistance(entry.from, entry.to, entry.dist);
         }
     }
 }
 
+// берем компактные прото остановки и кладем в каталог
+void Serializator::ReadCompactStops() {
+    const pr_transport_catalogue::CompactStops& pr_stops = pr_catalogue_.compact_stops();
+
+    const int stop_count = pr_stops.names_size();
+    if (pr_stops.coordinates_size() != 2 * stop_count ||
+        pr_stops.distance_counts_size() != stop_count ||
+        pr_stops.distance_stops_size() != pr_stops.distances_size()) {
+        throw runtime_error(__func__ + " corrupted compact stops"s);
+    }
+
+    catalogue_.reserve(stop_count, pr_catalogue_.buses_size());
+
+    // остановки по индексу
+    vector<const domain::Stop*> stops;
+    stops.reserve(stop_count);
+
+    int64_t lat = 0;
+    int64_t lng = 0;
+
+    for (int i = 0; i < stop_count; ++i) {
+        lat += pr_stops.coordinates(2 * i);
+        lng += pr_stops.coordinates(2 * i + 1);
+
+        geo_coord::Coordinates coordinates{lat / COORD_SCALE, lng / COORD_SCALE};
+
+        const string& name = pr_stops.names(i);
+        catalogue_.addStop(name, coordinates);
+        stops.push_back(catalogue_.findStop(name));
+    }
+
+    // счетчики из файла не доверенные: сравниваем без переполнения
+    const size_t distance_count = static_cast<size_t>(pr_stops.distances_size());
+    size_t pos = 0;
+    for (int i = 0; i < stop_count; ++i) {
+        const uint64_t count = pr_stops.distance_counts(i);
+        if (count > distance_count - pos) {
+            throw runtime_error(__func__ + " corrupted compact stops"s);
+        }
+
+        for (size_t j = pos; j < pos + count; ++j) {
+            const uint32_t to = pr_stops.distance_stops(static_cast<int>(j));
+            if (to >= stops.size()) {
+                throw runtime_error(__func__ + " corrupted compact stops"s);
+            }
+            // добавляем в каталог расстояния между остановками
+            catalogue_.setDistance(stops[i], stops[to], static_cast<int>(pr_stops.distances(static_cast<int>(j))));
+        }
+
+        pos += count;
+    }
+}
+
 // берем все прото автобусы и кладем в каталог
 void Serializator::ReadBuses() {
-    for (int i = 0; i < pr_catalogue_.buses_size(); ++i) {
-        PrBusToBus(pr_catalogue_.buses(i));
+    // маршруты и информацию о них собираем параллельно
+    vector<BusEntry> entries(pr_catalogue_.buses_size());
+
+    ParallelChunks(entries.size(), GetThreadCount(),
+                   [this, &entries](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            entries[i] = PrBusToBus(pr_catalogue_.buses(static_cast<int>(i)));
+        }
+    });
+
+    // добавляем маршруты в исходном порядке
+    for (size_t i = 0; i < entries.size(); ++i) {
+        BusEntry& entry = entries[i];
+
+        catalogue_.addBus(pr_catalogue_.buses(static_cast<int>(i)).name(), entry.last_stop,
+                          pr_catalogue_.buses(static_cast<int>(i)).is_roundtrip(), entry.stops);
+
+        const domain::Bus* bus = catalogue_.findBus(pr_catalogue_.buses(static_cast<int>(i)).name());
+        catalogue_.addBusInfo(bus, entry.info);
     }
 }
 
@@ -375,6 +696,28 @@ void Serializator::ReadRouter() {
     PrRouterToRouter(pr_catalogue_.router_settings());
 }
 
+void Serializator::ReadResponses() {
+    if (!pr_catalogue_.has_responses()) {
+        return;
+    }
+
+    for (const pr_response_cache::Fragment& pr_fragment : pr_catalogue_.responses().stops()) {
+        responses_.SetStop(pr_fragment.name(), {pr_fragment.head(), pr_fragment.tail()});
+    }
+
+    for (const pr_response_cache::Fragment& pr_fragment : pr_catalogue_.responses().buses()) {
+        responses_.SetBus(pr_fragment.name(), {pr_fragment.head(), pr_fragment.tail()});
+    }
+
+    if (!pr_catalogue_.responses().map().empty()) {
+        responses_.SetMap(pr_catalogue_.responses().map());
+    }
+
+    if (!pr_catalogue_.responses().compressed_map().empty()) {
+        responses_.SetCompressedMap(pr_catalogue_.responses().compressed_map());
+    }
+}
+
 // <-- deserialization
 
 } // namespace serialization
@@ -1,19 +1,32 @@
 #pragma once
 
 #include <filesystem>
+#include <vector>
 #include <graph.pb.h>
 #include <map_renderer.pb.h>
+#include <response_cache.pb.h>
 #include <svg.pb.h>
 #include <transport_catalogue.pb.h>
 #include <transport_router.pb.h>
 
 #include "map_renderer.h"
+#include "response_cache.h"
 #include "transport_router.h"
 
 namespace serialization {
 
+enum class Compression {
+    NONE,
+    GZIP
+};
+
 struct SerializatorSettings {
     std::filesystem::path path;
+    size_t threads = 0; // потоков для десериализации (0 - по числу ядер)
+    bool compact = false; // остановки в компактном виде (координаты с точностью 1e-6)
+    Compression compression = Compression::NONE;
+    bool precompute_responses = false; // сохранить готовые ответы на Stop и Bus
+    bool precompute_map = false; // сохранить готовую карту
 };
 
 class Serializator
@@ -21,35 +34,65 @@ class Serializator
 public:
     Serializator(transport_catalogue::TransportCatalogue& catalogue,
                  map_renderer::MapRenderer& renderer,
-                 transport_router::TransportRouter& router);
+                 transport_router::TransportRouter& router,
+                 response_cache::ResponseCache& responses);
 
     void SetSettings(const SerializatorSettings& settings);
+    const SerializatorSettings& GetSettings() const;
 
     void Serialize();
 
-    void Deserialize();
+    // компактная база хранит координаты с точностью 1e-6: округляет до нее
+    // координаты остановок каталога, чтобы информация о маршрутах, готовые
+    // ответы и карта считались по тем же координатам, что прочитаются из базы.
+    // Без compact ничего не делает
+    void RoundCoordinates();
+
+    // false, если файл базы не прочитан
+    bool Deserialize();
 
 private:
     transport_catalogue::TransportCatalogue& catalogue_;
     map_renderer::MapRenderer& renderer_;
     transport_router::TransportRouter& router_;
+    response_cache::ResponseCache& responses_;
     SerializatorSettings settings_;
     mutable pr_transport_catalogue::TransportCatalogue pr_catalogue_;
 
+    // разобранный прото автобус, готовый к добавлению в каталог
+    struct BusEntry {
+        const domain::Stop* last_stop = nullptr;
+        std::vector<const domain::Stop*> stops;
+        transport_catalogue::BusInfo info;
+    };
+
+    // разобранное расстояние между остановками
+    struct DistanceEntry {
+        const domain::Stop* from = nullptr;
+        const domain::Stop* to = nullptr;
+        int dist = 0;
+    };
+
+    size_t GetThreadCount() const;
+
     pr_transport_catalogue::Stop GetStop(const domain::Stop& stop) const;
     pr_transport_catalogue::Bus GetBus(const domain::Bus& bus) const;
 
     // кладем в файл
     void WriteStops();
+    void WriteCompactStops();
     void WriteBuses();
     void WriteRender();
     void WriteRouter();
+    void WriteResponses();
 
     // берем из файла
     void ReadStops();
+    void ReadCompactStops();
     void ReadBuses();
     void ReadRender();
     void ReadRouter();
+    void ReadResponses();
 
     // прото конвертеры
     pr_transport_catalogue::Stop StopToPrStop(const domain::Stop& stop) const;
@@ -61,7 +104,7 @@ private:
 
     // конвертеры
     void PrStopToStop(const pr_transport_catalogue::Stop& pr_stop);
-    void PrBusToBus(const pr_transport_catalogue::Bus& pr_bus);
+    BusEntry PrBusToBus(const pr_transport_catalogue::Bus& pr_bus) const;
     svg::Color PrColorToColor(const pr_svg::Color& pr_color);
     void PrRenderToRender(const pr_map_renderer::RenderSettings& pr_settings);
     void PrRouterToRouter(const pr_transport_router::RouterSettings& pr_settings);
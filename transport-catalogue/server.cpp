@@ -0,0 +1,592 @@
+#include "server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+#include "trace.h"
+
+namespace server {
+
+using namespace std::literals;
+
+namespace {
+
+bool SendAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        // клиент мог закрыть соединение, SIGPIPE не нужен
+        const ssize_t size = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(size));
+    }
+    return true;
+}
+
+} // namespace
+
+// ---------- Snapshot ------------------
+
+Snapshot::Snapshot(const std::string& settings_path)
+    : router_(catalogue_)
+    , serializator_(catalogue_, renderer_, router_, responses_)
+    , reader_(catalogue_, renderer_, router_, serializator_, responses_)
+    , request_handler_(catalogue_, renderer_, router_) {
+    std::ifstream settings(settings_path);
+    if (!settings) {
+        return;
+    }
+    loaded_ = reader_.GeneralLoadRequests(settings);
+
+    // дальше общие данные только читаются
+    reader_.Freeze(request_handler_);
+}
+
+bool Snapshot::IsLoaded() const {
+    return loaded_;
+}
+
+const std::filesystem::path& Snapshot::GetBasePath() const {
+    return serializator_.GetSettings().path;
+}
+
+bool Snapshot::ProcessRequest(std::string_view request, std::ostream& out) {
+    return reader_.ProcessRequest(request, out, request_handler_);
+}
+
+std::vector<memory::Usage> Snapshot::MemoryUsage() const {
+    return {catalogue_.memoryUsage(), router_.MemoryUsage(), responses_.MemoryUsage(), reader_.MemoryUsage()};
+}
+
+// ---------- Server ------------------
+
+namespace {
+
+// как часто простаивающий рабочий поток проверяет, не сменился ли снимок
+const auto IDLE_CHECK_INTERVAL = std::chrono::milliseconds(500);
+
+// сигнал остановки: сокет больше не принимает соединения, начатые дообслуживаются
+volatile std::sig_atomic_t stop_requested = 0;
+
+extern "C" void HandleStop(int) {
+    stop_requested = 1;
+}
+
+// без SA_RESTART, чтобы сигнал прерывал accept
+void SetStopHandler() {
+    struct sigaction action {};
+    action.sa_handler = HandleStop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+}
+
+// Следит за временем изменения и размером файла базы
+class BaseWatcher {
+public:
+    explicit BaseWatcher(std::filesystem::path path)
+        : path_(std::move(path))
+        , loaded_(Stamp()) {
+    }
+
+    // true, если файл изменился и не менялся с прошлой проверки (файл может еще
+    // записываться). Неудачная загрузка повторяется при следующем изменении
+    bool Check() {
+        const auto stamp = Stamp();
+        if (!stamp || stamp == loaded_) {
+            seen_.reset();
+            return false;
+        }
+        if (seen_ != stamp) {
+            seen_ = stamp;
+            return false;
+        }
+        seen_.reset();
+        loaded_ = stamp;
+        return true;
+    }
+
+private:
+    using FileStamp = std::pair<std::filesystem::file_time_type, std::uintmax_t>;
+
+    std::filesystem::path path_;
+    std::optional<FileStamp> loaded_;
+    std::optional<FileStamp> seen_;
+
+    // nullopt, если файла нет
+    std::optional<FileStamp> Stamp() const {
+        std::error_code error;
+        const auto time = std::filesystem::last_write_time(path_, error);
+        if (error) {
+            return std::nullopt;
+        }
+        const auto size = std::filesystem::file_size(path_, error);
+        if (error) {
+            return std::nullopt;
+        }
+        return FileStamp{time, size};
+    }
+};
+
+// Рабочие процессы основного процесса и их сокет. При любом выходе
+// из ServeProcesses, в том числе по исключению, процессы останавливаются
+// и дожидаются, а сокет закрывается и удаляется
+struct WorkerProcesses {
+    int listen_fd;
+    std::string socket_path;
+
+    // текущее поколение процессов и процессы со старой базой, которые дообслуживают соединения
+    std::vector<pid_t> current;
+    std::vector<pid_t> retired;
+    std::vector<pid_t> starting; // новое поколение, пока запускаются все его процессы
+
+    WorkerProcesses(int listen_fd, std::string socket_path)
+        : listen_fd(listen_fd)
+        , socket_path(std::move(socket_path)) {
+    }
+
+    WorkerProcesses(const WorkerProcesses&) = delete;
+    WorkerProcesses& operator=(const WorkerProcesses&) = delete;
+
+    ~WorkerProcesses() {
+        for (const auto& generation : {current, retired, starting}) {
+            for (pid_t pid : generation) {
+                kill(pid, SIGTERM);
+            }
+        }
+        // повторный сигнал остановки прерывает waitpid, ждем дальше
+        for (pid_t pid; (pid = waitpid(-1, nullptr, 0)) > 0 || (pid < 0 && errno == EINTR); ) {
+        }
+
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+};
+
+} // namespace
+
+Server::Server(std::string settings_path, const ServerSettings& settings)
+    : settings_path_(std::move(settings_path))
+    , settings_(settings) {
+}
+
+void Server::Run() {
+    auto snapshot = std::make_shared<Snapshot>(settings_path_);
+    if (!snapshot->IsLoaded()) {
+        throw std::runtime_error("cannot load base from settings "s + settings_path_);
+    }
+    Publish(std::move(snapshot));
+
+    // процессы запускаются до создания потоков, базу проверяет основной процесс
+    if (!settings_.socket_path.empty() && settings_.processes > 1) {
+        ServeProcesses();
+        return;
+    }
+
+    std::thread watcher;
+    if (settings_.reload_interval.count() > 0) {
+        watcher = std::thread([this] { WatchBase(); });
+    }
+
+    std::exception_ptr error;
+    try {
+        if (settings_.socket_path.empty()) {
+            ServeStream(std::cin, std::cout);
+        } else {
+            ServeSocket();
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    if (watcher.joinable()) {
+        StopWatching();
+        watcher.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+std::vector<memory::Usage> Server::MemoryUsage() const {
+    const std::shared_ptr<Snapshot> snapshot = GetSnapshot();
+    return snapshot ? snapshot->MemoryUsage() : std::vector<memory::Usage>{};
+}
+
+std::shared_ptr<Snapshot> Server::GetSnapshot() const {
+    std::lock_guard lock(snapshot_mutex_);
+    return snapshot_;
+}
+
+Snapshot& Server::GetSnapshot(LocalSnapshot& local) const {
+    // generation_ увеличивается после подмены снимка под тем же mutex
+    if (generation_.load(std::memory_order_acquire) != local.generation) {
+        std::lock_guard lock(snapshot_mutex_);
+        local.snapshot = snapshot_;
+        local.generation = generation_.load(std::memory_order_relaxed);
+    }
+    return *local.snapshot;
+}
+
+void Server::ReleaseStaleSnapshot(LocalSnapshot& local) const {
+    if (local.snapshot && generation_.load(std::memory_order_acquire) != local.generation) {
+        local = {};
+    }
+}
+
+std::shared_ptr<Snapshot> Server::Publish(std::shared_ptr<Snapshot> snapshot) {
+    std::lock_guard lock(snapshot_mutex_);
+    std::swap(snapshot_, snapshot);
+    generation_.fetch_add(1, std::memory_order_release);
+    return snapshot;
+}
+
+size_t Server::GetWorkerCount() const {
+    if (settings_.workers > 0) {
+        return settings_.workers;
+    }
+    // процессов уже по числу ядер
+    if (settings_.processes > 1) {
+        return 1;
+    }
+    return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+std::shared_ptr<Snapshot> Server::Reload() {
+    using Clock = std::chrono::steady_clock;
+
+    const auto start = Clock::now();
+    // испорченная или недописанная база не должна останавливать сервер:
+    // остается текущий снимок
+    std::shared_ptr<Snapshot> snapshot;
+    try {
+        snapshot = std::make_shared<Snapshot>(settings_path_);
+    } catch (const std::exception& e) {
+        std::cerr << "cannot reload base from settings "sv << settings_path_ << ": "sv << e.what() << '\n';
+        return nullptr;
+    }
+    const auto loaded = Clock::now();
+
+    if (!snapshot->IsLoaded()) {
+        std::cerr << "cannot reload base from settings "sv << settings_path_ << '\n';
+        return nullptr;
+    }
+
+    auto previous = Publish(std::move(snapshot));
+    std::cerr << "base reloaded in "sv
+              << std::chrono::duration_cast<std::chrono::milliseconds>(loaded - start).count()
+              << " ms\n"sv;
+    return previous;
+}
+
+void Server::WatchBase() {
+    BaseWatcher base(GetSnapshot()->GetBasePath());
+
+    // Снятые снимки освобождаются здесь, а не в потоке последнего запроса:
+    // пока снимок в списке, рабочие потоки только уменьшают счетчик ссылок.
+    // При частых перезагрузках в списке может быть несколько снимков
+    std::vector<std::shared_ptr<Snapshot>> retired;
+
+    std::unique_lock lock(stop_mutex_);
+    while (!stop_.wait_for(lock, settings_.reload_interval, [this] { return stopping_; })) {
+        retired.erase(std::remove_if(retired.begin(), retired.end(),
+                                     [](const std::shared_ptr<Snapshot>& snapshot) {
+                                         return snapshot.use_count() == 1;
+                                     }),
+                      retired.end());
+        if (!base.Check()) {
+            continue;
+        }
+
+        lock.unlock();
+        if (auto previous = Reload()) {
+            retired.push_back(std::move(previous));
+        }
+        lock.lock();
+    }
+}
+
+void Server::StopWatching() {
+    {
+        std::lock_guard lock(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_.notify_all();
+}
+
+void Server::ServeStream(std::istream& in, std::ostream& out) {
+    LocalSnapshot local;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (GetSnapshot(local).ProcessRequest(line, out)) {
+            out << std::endl;
+        }
+    }
+}
+
+int Server::OpenSocket() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (settings_.socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("socket path is too long: "s + settings_.socket_path);
+    }
+    std::copy(settings_.socket_path.begin(), settings_.socket_path.end(), address.sun_path);
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "socket");
+    }
+
+    // сокет мог остаться от прошлого запуска
+    unlink(settings_.socket_path.c_str());
+
+    if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(listen_fd, SOMAXCONN) < 0) {
+        const int error = errno;
+        close(listen_fd);
+        throw std::system_error(error, std::generic_category(), "bind "s + settings_.socket_path);
+    }
+
+    return listen_fd;
+}
+
+void Server::ServeSocket() {
+    const int listen_fd = OpenSocket();
+    SetStopHandler();
+
+    AcceptConnections(listen_fd);
+
+    close(listen_fd);
+    unlink(settings_.socket_path.c_str());
+}
+
+void Server::AcceptConnections(int listen_fd) {
+    // принятые соединения ждут свободного потока
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<int> connections;
+    std::unordered_set<int> active; // соединения, которые обслуживаются сейчас
+    bool done = false;
+
+    // сигналы остановки получает только этот поток, прерывая accept
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+    std::vector<std::thread> workers;
+    const size_t worker_count = GetWorkerCount();
+    workers.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers.emplace_back([&] {
+            LocalSnapshot local;
+            while (true) {
+                int fd = -1;
+                {
+                    std::unique_lock lock(mutex);
+                    // простаивающий поток не держит снятый снимок
+                    while (!ready.wait_for(lock, IDLE_CHECK_INTERVAL, [&] { return done || !connections.empty(); })) {
+                        ReleaseStaleSnapshot(local);
+                    }
+                    if (connections.empty()) {
+                        return;
+                    }
+                    fd = connections.front();
+                    connections.pop_front();
+                    if (done) {
+                        shutdown(fd, SHUT_RD);
+                    }
+                    active.insert(fd);
+                }
+                ServeConnection(fd, local);
+                {
+                    std::lock_guard lock(mutex);
+                    active.erase(fd);
+                }
+            }
+        });
+    }
+
+    pthread_sigmask(SIG_UNBLOCK, &stop_signals, nullptr);
+
+    while (!stop_requested) {
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        {
+            std::lock_guard lock(mutex);
+            connections.push_back(fd);
+        }
+        ready.notify_one();
+    }
+
+    // Уже полученные запросы обслуживаются, новых соединение не ждет:
+    // после чтения принятых данных recv вернет 0
+    {
+        std::lock_guard lock(mutex);
+        done = true;
+        for (int fd : active) {
+            shutdown(fd, SHUT_RD);
+        }
+    }
+    ready.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+pid_t Server::StartProcess(int listen_fd) {
+    const pid_t pid = fork();
+    if (pid < 0) {
+        throw std::system_error(errno, std::generic_category(), "fork");
+    }
+    if (pid > 0) {
+        return pid;
+    }
+
+    // Рабочий процесс: снимок базы уже в памяти, его страницы общие
+    // с основным процессом, пока никто в них не пишет
+    trace::ResetAfterFork();
+    thread_pool::ResetAfterFork();
+    int code = 0;
+    try {
+        AcceptConnections(listen_fd);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        code = 1;
+    } catch (...) {
+        // исключение не должно дойти до кода основного процесса в стеке
+        code = 1;
+    }
+    // _Exit не вызывает деструкторы, трассу пишем сами
+    trace::Finish();
+    std::_Exit(code);
+}
+
+void Server::ServeProcesses() {
+    WorkerProcesses workers(OpenSocket(), settings_.socket_path);
+    SetStopHandler();
+
+    for (size_t i = 0; i < settings_.processes; ++i) {
+        workers.current.push_back(StartProcess(workers.listen_fd));
+    }
+
+    BaseWatcher base(GetSnapshot()->GetBasePath());
+
+    // сигнал остановки прерывает ожидание
+    const auto tick = std::chrono::milliseconds(100);
+    auto since_check = std::chrono::milliseconds(0);
+
+    while (!stop_requested) {
+        // завершившиеся процессы текущего поколения заменяются новыми
+        int status = 0;
+        for (pid_t pid; (pid = waitpid(-1, &status, WNOHANG)) > 0; ) {
+            auto& retired = workers.retired;
+            retired.erase(std::remove(retired.begin(), retired.end(), pid), retired.end());
+            auto& current = workers.current;
+            if (auto it = std::find(current.begin(), current.end(), pid); it != current.end() && !stop_requested) {
+                std::cerr << "worker "sv << pid << " exited, restarting\n"sv;
+                *it = StartProcess(workers.listen_fd);
+            }
+        }
+
+        std::this_thread::sleep_for(tick);
+        since_check += tick;
+
+        if (settings_.reload_interval.count() == 0 || since_check < settings_.reload_interval) {
+            continue;
+        }
+        since_check = std::chrono::milliseconds(0);
+
+        // новая база загружается здесь и достается новому поколению процессов,
+        // старые перестают принимать соединения и завершаются. Если база
+        // не прочитана, работает прежнее поколение со старой базой
+        if (!base.Check() || !Reload()) {
+            continue;
+        }
+        for (size_t i = 0; i < settings_.processes; ++i) {
+            workers.starting.push_back(StartProcess(workers.listen_fd));
+        }
+        for (pid_t pid : workers.current) {
+            kill(pid, SIGTERM);
+        }
+        workers.retired.insert(workers.retired.end(), workers.current.begin(), workers.current.end());
+        workers.current = std::move(workers.starting);
+        workers.starting.clear();
+    }
+}
+
+void Server::ServeConnection(int fd, LocalSnapshot& local) {
+    std::string input; // принятые данные с неполной последней строкой
+    std::ostringstream output;
+    char buffer[64 * 1024];
+
+    // ответы на все полные строки из прочитанного отправляются одним вызовом
+    auto process = [&](std::string_view request) {
+        if (GetSnapshot(local).ProcessRequest(request, output)) {
+            output.put('\n');
+        }
+    };
+
+    bool connected = true;
+    while (connected) {
+        const ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size <= 0) {
+            // последний запрос может быть без перевода строки
+            process(input);
+            SendAll(fd, output.str());
+            break;
+        }
+        input.append(buffer, static_cast<size_t>(size));
+
+        size_t begin = 0;
+        for (size_t end = input.find('\n'); end != input.npos; end = input.find('\n', begin)) {
+            process(std::string_view(input).substr(begin, end - begin));
+            begin = end + 1;
+        }
+        input.erase(0, begin);
+
+        connected = SendAll(fd, output.str());
+        output.str({});
+    }
+
+    close(fd);
+}
+
+} // namespace server
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <sys/types.h>
+
+#include "json_reader.h"
+#include "map_renderer.h"
+#include "memory.h"
+#include "request_handler.h"
+#include "response_cache.h"
+#include "serialization.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+namespace server {
+
+struct ServerSettings {
+    std::string socket_path; // пусто - запросы из stdin, ответы в stdout
+    size_t workers = 0; // потоков для обслуживания соединений (0 - по числу ядер, а при processes - 1)
+    size_t processes = 1; // рабочих процессов для сокета, база загружается до их запуска
+    std::chrono::milliseconds reload_interval{1000}; // период проверки файла базы (0 - без перезагрузки)
+};
+
+// Загруженная база со всем, что нужно для ответов. После загрузки не меняется
+// (кроме внутренне синхронизированного кэша карт областей) и разделяется потоками
+class Snapshot {
+public:
+    // settings_path - JSON с serialization_settings
+    explicit Snapshot(const std::string& settings_path);
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    // false, если файл базы не прочитан
+    bool IsLoaded() const;
+
+    const std::filesystem::path& GetBasePath() const;
+
+    bool ProcessRequest(std::string_view request, std::ostream& out);
+
+    // оценки памяти каталога, маршрутизатора, готовых ответов и запросов
+    std::vector<memory::Usage> MemoryUsage() const;
+
+private:
+    transport_catalogue::TransportCatalogue catalogue_;
+    map_renderer::MapRenderer renderer_;
+    transport_router::TransportRouter router_;
+    response_cache::ResponseCache responses_;
+    serialization::Serializator serializator_;
+    json_reader::JsonReader reader_;
+    request_handler::RequestHandler request_handler_;
+
+    bool loaded_ = false;
+};
+
+// Обслуживает запросы к загруженной базе: один JSON-объект запроса в строке,
+// ответ - одна строка в том же порядке. Каждый запрос берет текущий снимок базы;
+// новый снимок загружается в фоне при изменении файла базы и подменяет старый,
+// запросы, уже взявшие старый снимок, дорабатывают с ним
+class Server {
+public:
+    Server(std::string settings_path, const ServerSettings& settings);
+
+    // работает до конца ввода или ошибки сокета
+    void Run();
+
+    // память текущего снимка базы; пусто, если база не загружена
+    std::vector<memory::Usage> MemoryUsage() const;
+
+private:
+    std::string settings_path_;
+    ServerSettings settings_;
+
+    // Текущий снимок подменяется под snapshot_mutex_ вместе с увеличением
+    // generation_. Рабочие потоки держат свою копию указателя (LocalSnapshot)
+    // и на запрос только читают generation_; mutex берется, лишь когда
+    // снимок сменился (std::atomic_load для shared_ptr в libstdc++ берет
+    // глобальную блокировку на каждый вызов)
+    mutable std::mutex snapshot_mutex_;
+    std::shared_ptr<Snapshot> snapshot_;
+    std::atomic<uint64_t> generation_{0};
+
+    // копия текущего снимка в одном потоке
+    struct LocalSnapshot {
+        uint64_t generation = 0;
+        std::shared_ptr<Snapshot> snapshot;
+    };
+
+    // остановка фонового потока перезагрузки
+    std::mutex stop_mutex_;
+    std::condition_variable stop_;
+    bool stopping_ = false;
+
+    std::shared_ptr<Snapshot> GetSnapshot() const;
+
+    // снимок для запроса: копия обновляется, только если снимок сменился
+    Snapshot& GetSnapshot(LocalSnapshot& local) const;
+
+    // отпускает копию устаревшего снимка в простаивающем потоке
+    void ReleaseStaleSnapshot(LocalSnapshot& local) const;
+
+    size_t GetWorkerCount() const;
+
+    // делает снимок текущим и возвращает прежний
+    std::shared_ptr<Snapshot> Publish(std::shared_ptr<Snapshot> snapshot);
+
+    // загружает новый снимок и подменяет им текущий; возвращает прежний снимок
+    // или nullptr, если база не прочитана (тогда текущий снимок не меняется).
+    // Прежний снимок освобождает вызывающий, когда его больше никто не держит
+    std::shared_ptr<Snapshot> Reload();
+
+    // проверяет файл базы раз в reload_interval, пока не вызван StopWatching
+    void WatchBase();
+    void StopWatching();
+
+    // запросы из потока, каждый ответ сразу выталкивается
+    void ServeStream(std::istream& in, std::ostream& out);
+
+    // Unix-сокет: соединения принимаются в основном потоке и обслуживаются пулом
+    // до сигнала SIGTERM или SIGINT
+    int OpenSocket();
+    void ServeSocket();
+    void AcceptConnections(int listen_fd);
+    void ServeConnection(int fd, LocalSnapshot& local);
+
+    // Pre-fork: процессы принимают соединения с общего сокета, снимок базы
+    // достается им от основного процесса без копирования. Основной процесс
+    // перезапускает упавшие процессы и при новой базе запускает новое поколение
+    pid_t StartProcess(int listen_fd);
+    void ServeProcesses();
+};
+
+} // namespace server
@@ -1,5 +1,9 @@
 #include "svg.h"
 
+#include <algorithm>
+#include <charconv>
+#include <sstream>
+
 namespace svg {
 
 using namespace std::literals;
@@ -128,6 +132,10 @@ Circle& Circle::SetRadius(double radius)  {
     return *this;
 }
 
+size_t Circle::MemoryUsage() const {
+    return sizeof(*this) + AttrsMemoryUsage();
+}
+
 void Circle::RenderObject(const RenderContext& context) const {
     auto& out = context.out;
     out << "<circle cx=\""sv << center_.x << "\" cy=\""sv << center_.y << "\" "sv;
@@ -143,6 +151,10 @@ Polyline& Polyline::AddPoint(Point point) {
     return *this;
 }
 
+size_t Polyline::MemoryUsage() const {
+    return sizeof(*this) + AttrsMemoryUsage() + memory::VectorBytes(points_);
+}
+
 void Polyline::RenderObject(const RenderContext& context) const {
     auto& out = context.out;
     out << "<polyline points=\""sv;
@@ -189,26 +201,46 @@ Text& Text::SetData(std::string data) {
     return *this;
 }
 
-void Text::RenderObject(const RenderContext& context) const {
-    std::vector<std::pair<char, std::string>> spec_symbols{ {'&', "&amp;"s},{'"', "&quot;"s},{'<', "&lt;"s},{'>', "&gt;"s},{'\'', "&apos;"} };
-    std::string out_str = data_;
-    size_t pos_space;
-    for (auto& [symbol, str] : spec_symbols) {
-        while (true) {
-            if (out_str.find("&amp;"s) != data_.npos && symbol == '&') {
-                break;
-            }
-            pos_space = out_str.find(symbol);
-            if (pos_space != data_.npos) {
-                out_str.erase(pos_space, 1u);
-                out_str.insert(pos_space, str);
-            }
-            else {
-                break;
+size_t Text::MemoryUsage() const {
+    return sizeof(*this) + AttrsMemoryUsage() + memory::StringBytes(font_family_)
+         + memory::StringBytes(font_weight_) + memory::StringBytes(data_);
+}
+
+void RenderText(std::ostream& out, std::string_view data) {
+    // Заменяется только первый '&' и только если в тексте еще нет "&amp;",
+    // остальные спецсимволы заменяются все
+    bool amp_done = data.find("&amp;"sv) != data.npos;
+
+    for (const char c : data) {
+        switch (c) {
+        case '&':
+            if (!amp_done) {
+                out << "&amp;"sv;
+                amp_done = true;
+            } else {
+                out.put(c);
             }
+            break;
+        case '"':
+            out << "&quot;"sv;
+            break;
+        case '<':
+            out << "&lt;"sv;
+            break;
+        case '>':
+            out << "&gt;"sv;
+            break;
+        case '\'':
+            out << "&apos;"sv;
+            break;
+        default:
+            out.put(c);
+            break;
         }
     }
+}
 
+void Text::RenderObject(const RenderContext& context) const {
     auto& out = context.out;
     out << "<text"sv;
     RenderAttrs(out);
@@ -222,7 +254,9 @@ void Text::RenderObject(const RenderContext& context) const {
         out << " font-weight=\""sv << font_weight_ << "\""sv;
     }
 
-    out << ">"sv << out_str << "</text>"sv;
+    out << ">"sv;
+    RenderText(out, data_);
+    out << "</text>"sv;
 }
 
 // ---------- Document ------------------
@@ -240,4 +274,160 @@ void Document::Render(std::ostream& out) const {
     out << "</svg>"sv;
 }
 
+size_t Document::MemoryUsage() const {
+    size_t bytes = memory::VectorBytes(objects_);
+    for (const auto& object : objects_) {
+        bytes += object->MemoryUsage();
+    }
+    return bytes;
+}
+
+// ---------- PathStyle ------------------
+
+std::string PathStyle::Format() const {
+    std::ostringstream out;
+    RenderAttrs(out);
+    return out.str();
+}
+
+// ---------- TextStyle ------------------
+
+TextStyle& TextStyle::SetOffset(Point offset) {
+    offset_ = offset;
+    return *this;
+}
+
+TextStyle& TextStyle::SetFontSize(uint32_t size) {
+    font_size_ = size;
+    return *this;
+}
+
+TextStyle& TextStyle::SetFontFamily(std::string font_family) {
+    font_family_ = std::move(font_family);
+    return *this;
+}
+
+TextStyle& TextStyle::SetFontWeight(std::string font_weight) {
+    font_weight_ = std::move(font_weight);
+    return *this;
+}
+
+TextFormat TextStyle::Format() const {
+    TextFormat format;
+
+    std::ostringstream attrs;
+    RenderAttrs(attrs);
+    format.attrs = attrs.str();
+
+    std::ostringstream font;
+    font << "dx=\""sv << offset_.x << "\" dy=\""sv << offset_.y << "\" "sv;
+    font << "font-size=\""sv << font_size_ << "\" "sv;
+    if (!font_family_.empty()) {
+        font << "font-family=\""sv << font_family_ << "\""sv;
+    }
+    if (!font_weight_.empty()) {
+        font << " font-weight=\""sv << font_weight_ << "\""sv;
+    }
+    format.font = font.str();
+
+    return format;
+}
+
+// ---------- StreamWriter ------------------
+
+StreamWriter::StreamWriter(std::ostream& out, bool with_header)
+    : out_(out) {
+    if (!with_header) {
+        return;
+    }
+    out_ << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+    out_ << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
+}
+
+void StreamWriter::SetPrecision(int precision) {
+    precision_ = precision;
+}
+
+void StreamWriter::StyleSheet(std::string_view rules) {
+    out_ << "  <style>"sv << rules << "</style>\n"sv;
+}
+
+void StreamWriter::Circle(Point center, double radius, std::string_view style) {
+    out_ << "  <circle cx=\""sv;
+    Number(center.x);
+    out_ << "\" cy=\""sv;
+    Number(center.y);
+    out_ << "\" r=\""sv;
+    Number(radius);
+    out_ << "\""sv << style << "/>\n"sv;
+}
+
+void StreamWriter::BeginPolyline() {
+    out_ << "  <polyline points=\""sv;
+    first_point_ = true;
+}
+
+void StreamWriter::PolylinePoint(Point point) {
+    if (!first_point_) {
+        out_.put(' ');
+    }
+    first_point_ = false;
+    Number(point.x);
+    out_.put(',');
+    Number(point.y);
+}
+
+void StreamWriter::EndPolyline(std::string_view style) {
+    out_ << "\""sv << style << "/>\n"sv;
+}
+
+void StreamWriter::Text(Point position, std::string_view data, const TextFormat& format) {
+    out_ << "  <text"sv << format.attrs << " x=\""sv;
+    Number(position.x);
+    out_ << "\" y=\""sv;
+    Number(position.y);
+    out_ << "\""sv;
+    if (!format.font.empty()) {
+        out_ << ' ' << format.font;
+    }
+    out_ << ">"sv;
+    RenderText(out_, data);
+    out_ << "</text>\n"sv;
+}
+
+void StreamWriter::Finish() {
+    out_ << "</svg>"sv;
+}
+
+void StreamWriter::Number(double value) {
+    char buffer[64];
+
+    if (precision_ < 0) {
+        // как operator<< по умолчанию: 6 значащих цифр, формат %g
+        auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value, std::chars_format::general, 6);
+        out_.write(buffer, ptr - buffer);
+        return;
+    }
+
+    auto [ptr, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value, std::chars_format::fixed, precision_);
+    if (ec != std::errc{}) {
+        // слишком большое число для буфера
+        ptr = std::to_chars(std::begin(buffer), std::end(buffer), value, std::chars_format::general, 6).ptr;
+    } else if (std::find(buffer, ptr, '.') != ptr) {
+        // лишние нули и точка в конце не выводятся
+        while (*(ptr - 1) == '0') {
+            --ptr;
+        }
+        if (*(ptr - 1) == '.') {
+            --ptr;
+        }
+    }
+
+    std::string_view number(buffer, ptr - buffer);
+    if (number == "-0"sv) {
+        number = "0"sv;
+    }
+    out_ << number;
+}
+
 }  // namespace svg
@@ -4,11 +4,14 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
 #include <variant>
 //#include <iomanip>  //for std::setprecision
 
+#include "memory.h"
+
 namespace svg {
 
 struct Rgb {
@@ -95,6 +98,19 @@ public:
 protected:
     ~PathProps() = default;
 
+    // память в куче под названия цветов
+    size_t AttrsMemoryUsage() const {
+        size_t bytes = 0;
+        for (const auto* color : {&fill_color_, &stroke_color_}) {
+            if (*color) {
+                if (const auto* name = std::get_if<std::string>(&**color)) {
+                    bytes += memory::StringBytes(*name);
+                }
+            }
+        }
+        return bytes;
+    }
+
     void RenderAttrs(std::ostream& out) const {
         using namespace std::literals;
 
@@ -164,6 +180,9 @@ class Object {
 public:
     void Render(const RenderContext& context) const;
 
+    // размер объекта вместе с его памятью в куче, байты
+    virtual size_t MemoryUsage() const = 0;
+
     virtual ~Object() = default;
 
 private:
@@ -180,6 +199,8 @@ public:
     Circle& SetCenter(Point center);
     Circle& SetRadius(double radius);
 
+    size_t MemoryUsage() const override;
+
 private:
     void RenderObject(const RenderContext& context) const override;
 
@@ -196,6 +217,8 @@ public:
     // Добавляет очередную вершину к ломаной линии
     Polyline& AddPoint(Point point);
 
+    size_t MemoryUsage() const override;
+
 private:
     void RenderObject(const RenderContext& context) const override;
 
@@ -226,6 +249,8 @@ public:
     // Задаёт текстовое содержимое объекта (отображается внутри тега text)
     Text& SetData(std::string data);
 
+    size_t MemoryUsage() const override;
+
 private:
     void RenderObject(const RenderContext& context) const override;
 
@@ -269,6 +294,80 @@ public:
 
     // Выводит в ostream svg-представление документа
     void Render(std::ostream& out) const;
+
+    // память в куче под объекты документа, байты
+    size_t MemoryUsage() const;
+};
+
+/*
+ * Атрибуты заливки и обводки, отформатированные один раз для многих элементов
+ */
+class PathStyle final : public PathProps<PathStyle> {
+public:
+    std::string Format() const;
 };
 
+// Отформатированные атрибуты текста: до координат и после них (может быть пусто)
+struct TextFormat {
+    std::string attrs;
+    std::string font;
+};
+
+/*
+ * Атрибуты текста, кроме координат и содержимого
+ */
+class TextStyle final : public PathProps<TextStyle> {
+public:
+    TextStyle& SetOffset(Point offset);
+    TextStyle& SetFontSize(uint32_t size);
+    TextStyle& SetFontFamily(std::string font_family);
+    TextStyle& SetFontWeight(std::string font_weight);
+
+    TextFormat Format() const;
+
+private:
+    Point offset_ = {0.0, 0.0};
+    uint32_t font_size_ = 1;
+    std::string font_family_;
+    std::string font_weight_;
+};
+
+/*
+ * Потоковый вывод SVG: элементы сразу пишутся в поток, документ не хранится.
+ * Вывод совпадает с Document::Render для тех же объектов
+ */
+class StreamWriter {
+public:
+    // Выводит заголовок документа; with_header = false - для вывода части документа
+    explicit StreamWriter(std::ostream& out, bool with_header = true);
+
+    // число знаков после точки в координатах и размерах, -1 - 6 значащих цифр
+    void SetPrecision(int precision);
+
+    // таблица стилей <style> с CSS-правилами rules
+    void StyleSheet(std::string_view rules);
+
+    void Circle(Point center, double radius, std::string_view style);
+
+    // Ломаная выводится по точкам
+    void BeginPolyline();
+    void PolylinePoint(Point point);
+    void EndPolyline(std::string_view style);
+
+    void Text(Point position, std::string_view data, const TextFormat& format);
+
+    // Закрывает документ
+    void Finish();
+
+private:
+    std::ostream& out_;
+    bool first_point_ = true;
+    int precision_ = -1;
+
+    void Number(double value);
+};
+
+// Выводит текст с заменой спецсимволов XML
+void RenderText(std::ostream& out, std::string_view data);
+
 }  // namespace svg
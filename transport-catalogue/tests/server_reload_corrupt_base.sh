@@ -0,0 +1,69 @@
+#!/usr/bin/env bash
+# Сервер в режиме stdin не падает, когда файл базы заменяется мусором или недописан,
+# отвечает со старой базой и загружает исправленную базу при следующем изменении
+# usage: server_reload_corrupt_base.sh transport_catalogue transport_catalogue_bench
+set -euo pipefail
+
+program=$1
+bench=$2
+
+dir=$(mktemp -d)
+server_pid=
+trap 'kill $server_pid 2>/dev/null || true; rm -rf "$dir"' EXIT
+
+"$bench" --stops 20 --buses 3 --requests 5 --db "$dir/base.db" \
+         --write-base "$dir/base.json" --write-requests "$dir/requests.json" >/dev/null
+"$program" make_base < "$dir/base.json"
+
+request='{"id":1,"type":"Bus","name":"1"}'
+
+coproc SERVER { "$program" serve --settings "$dir/requests.json" --reload 50 2>"$dir/stderr"; }
+server_pid=$SERVER_PID
+
+ask() {
+    echo "$request" >&"${SERVER[1]}"
+    local answer
+    read -r -t 10 answer <&"${SERVER[0]}"
+    echo "$answer"
+}
+
+expected=$(ask)
+case "$expected" in
+    *'"stop_count"'*) ;;
+    *) echo "unexpected answer: $expected" >&2; exit 1 ;;
+esac
+
+alive() {
+    if ! kill -0 "$server_pid" 2>/dev/null; then
+        echo "server exited after $1" >&2
+        cat "$dir/stderr" >&2
+        exit 1
+    fi
+}
+
+cp "$dir/base.db" "$dir/good.db"
+
+# мусор вместо базы: база не читается, сервер отвечает со старой
+for i in $(seq 100); do
+    printf 'not a transport catalogue base\n'
+done > "$dir/base.db"
+sleep 1
+alive "garbage base"
+[ "$(grep -c "cannot reload base" "$dir/stderr")" = 1 ]
+[ "$(ask)" = "$expected" ]
+
+# недописанная база: разбор ссылок на остановки бросает исключение
+head -c "$(( $(stat -c %s "$dir/good.db") / 2 ))" "$dir/good.db" > "$dir/base.db"
+sleep 1
+alive "half-written base"
+[ "$(grep -c "cannot reload base" "$dir/stderr")" = 2 ]
+[ "$(ask)" = "$expected" ]
+
+# исправленная база загружается при следующем изменении файла
+cp "$dir/good.db" "$dir/base.db"
+sleep 1
+grep -q "base reloaded" "$dir/stderr"
+[ "$(ask)" = "$expected" ]
+
+exec {SERVER[1]}>&-
+wait "$server_pid"
@@ -0,0 +1,156 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace thread_pool {
+
+ThreadPool::ThreadPool(size_t threads) {
+    threads_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back([this] {
+            Work();
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stopped_ = true;
+    }
+    ready_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::GetSize() const {
+    return threads_.size();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    ready_.notify_one();
+}
+
+void ThreadPool::Work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex_);
+            ready_.wait(lock, [this] {
+                return stopped_ || !tasks_.empty();
+            });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+namespace {
+
+// пул не удаляется: при выходе его потоки ждут задач и завершаются вместе с процессом
+std::atomic<ThreadPool*> shared_pool{nullptr};
+
+// общее состояние одного Run; живет, пока его держит хоть один помощник
+struct RunState {
+    const std::function<void(size_t)>* job;
+    size_t count;
+
+    std::atomic<size_t> next{0};
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t done = 0;
+    std::exception_ptr error;
+
+    // берет задачи, пока они есть; job разыменовывается только для взятой
+    // задачи, а взятая задача всегда завершается до возврата из Run
+    void Work() {
+        for (size_t i = next++; i < count; i = next++) {
+            std::exception_ptr job_error;
+            try {
+                (*job)(i);
+            } catch (...) {
+                job_error = std::current_exception();
+            }
+
+            std::lock_guard lock(mutex);
+            if (job_error && !error) {
+                error = job_error;
+            }
+            if (++done == count) {
+                finished.notify_all();
+            }
+        }
+    }
+};
+
+} // namespace
+
+ThreadPool& Shared() {
+    ThreadPool* pool = shared_pool.load(std::memory_order_acquire);
+    if (pool) {
+        return *pool;
+    }
+
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    auto created = std::make_unique<ThreadPool>(cores - 1);
+    if (shared_pool.compare_exchange_strong(pool, created.get(), std::memory_order_acq_rel)) {
+        return *created.release();
+    }
+    // другой поток успел раньше
+    return *pool;
+}
+
+void ResetAfterFork() {
+    shared_pool.store(nullptr, std::memory_order_release);
+}
+
+void Run(size_t count, size_t helpers, const std::function<void(size_t)>& job) {
+    if (count == 0) {
+        return;
+    }
+
+    helpers = std::min(helpers, count - 1);
+    if (helpers > 0) {
+        helpers = std::min(helpers, Shared().GetSize());
+    }
+    if (helpers == 0) {
+        for (size_t i = 0; i < count; ++i) {
+            job(i);
+        }
+        return;
+    }
+
+    auto state = std::make_shared<RunState>();
+    state->job = &job;
+    state->count = count;
+
+    for (size_t i = 0; i < helpers; ++i) {
+        Shared().Submit([state] {
+            state->Work();
+        });
+    }
+    state->Work();
+
+    std::unique_lock lock(state->mutex);
+    state->finished.wait(lock, [&state] {
+        return state->done == state->count;
+    });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+} // namespace thread_pool
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace thread_pool {
+
+// Постоянные потоки с общей очередью задач: параллельная работа не создает
+// потоки на каждый вызов, и сколько бы вызовов ни шло одновременно
+// (например, в рабочих потоках сервера), помощников не больше размера пула
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetSize() const;
+
+    // задача выполнится в одном из потоков пула, когда он освободится
+    void Submit(std::function<void()> task);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopped_ = false;
+    std::vector<std::thread> threads_;
+
+    void Work();
+};
+
+// Общий пул процесса на hardware_concurrency - 1 потоков (вызывающий поток
+// работает сам), создается при первом обращении
+ThreadPool& Shared();
+
+// В процессе после fork: потоков пула там нет, при следующем обращении
+// создается новый пул, старый не трогается
+void ResetAfterFork();
+
+// Выполняет jobs[0..count) параллельно: задачи разбирают вызывающий поток
+// и не больше helpers потоков общего пула. Возвращает управление, когда
+// выполнены все задачи, исключение первой упавшей пробрасывается. Помощник,
+// не успевший начать, не задерживает вызов: вызывающий поток разберет все сам
+void Run(size_t count, size_t helpers, const std::function<void(size_t)>& job);
+
+} // namespace thread_pool
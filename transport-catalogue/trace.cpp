@@ -0,0 +1,136 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "json.h"
+
+namespace trace {
+
+using namespace std::literals;
+
+namespace {
+
+struct Event {
+    const char* name;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+};
+
+// события одного потока; пишет в них только этот поток
+struct ThreadEvents {
+    int tid = 0;
+    std::vector<Event> events;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::string path;
+    pid_t pid = 0; // процесс, вызвавший Enable
+    std::chrono::steady_clock::time_point origin;
+    // буферы живут дольше своих потоков (например, потоков std::async)
+    std::vector<std::unique_ptr<ThreadEvents>> threads;
+};
+
+Registry& GetRegistry() {
+    static Registry registry;
+    return registry;
+}
+
+ThreadEvents& GetThreadEvents() {
+    thread_local ThreadEvents* events = nullptr;
+    if (!events) {
+        Registry& registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        registry.threads.push_back(std::make_unique<ThreadEvents>());
+        events = registry.threads.back().get();
+        events->tid = static_cast<int>(registry.threads.size());
+    }
+    return *events;
+}
+
+// точное значение в микросекундах с долями до наносекунды: double в выводе
+// JSON держит 6 значащих цифр, и ts дальше секунды от начала теряет точность
+std::string ToMicroseconds(std::chrono::steady_clock::duration duration) {
+    const uint64_t ns = static_cast<uint64_t>(
+        std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0));
+    const std::string fraction = std::to_string(ns % 1000);
+    return std::to_string(ns / 1000) + "."s + std::string(3 - fraction.size(), '0') + fraction;
+}
+
+} // namespace
+
+namespace details {
+
+void Record(const char* name, std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end) {
+    GetThreadEvents().events.push_back({name, start, end});
+}
+
+} // namespace details
+
+void Enable(std::string path) {
+    Registry& registry = GetRegistry();
+    {
+        std::lock_guard lock(registry.mutex);
+        registry.path = std::move(path);
+        registry.pid = getpid();
+        registry.origin = std::chrono::steady_clock::now();
+    }
+    details::enabled.store(true, std::memory_order_relaxed);
+}
+
+void ResetAfterFork() {
+    Registry& registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+    for (auto& thread : registry.threads) {
+        thread->events.clear();
+    }
+}
+
+void Finish() {
+    if (!IsEnabled()) {
+        return;
+    }
+
+    Registry& registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+
+    const pid_t pid = getpid();
+    std::string path = registry.path;
+    if (pid != registry.pid) {
+        path += "."s + std::to_string(pid);
+    }
+
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "cannot write trace "sv << path << '\n';
+        return;
+    }
+
+    json::Writer writer(out, false);
+    writer.StartDict().Key("displayTimeUnit"sv).Value("ms"sv).Key("traceEvents"sv).StartArray();
+    for (const auto& thread : registry.threads) {
+        for (const Event& event : thread->events) {
+            writer.StartDict().
+                Key("dur"sv).RawValue(ToMicroseconds(event.end - event.start)).
+                Key("name"sv).Value(event.name).
+                Key("ph"sv).Value("X"sv).
+                Key("pid"sv).Value(static_cast<int>(pid)).
+                Key("tid"sv).Value(thread->tid).
+                Key("ts"sv).RawValue(ToMicroseconds(event.start - registry.origin)).
+                EndDict();
+        }
+    }
+    writer.EndArray().EndDict();
+}
+
+} // namespace trace
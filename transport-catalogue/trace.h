@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace trace {
+
+namespace details {
+
+// запись включается один раз до начала работы, дальше флаг только читается
+inline std::atomic<bool> enabled{false};
+
+void Record(const char* name, std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end);
+
+} // namespace details
+
+// Включает запись событий; Finish запишет их в path в формате Chrome trace-event
+// (открывается в chrome://tracing и Perfetto)
+void Enable(std::string path);
+
+inline bool IsEnabled() {
+    return details::enabled.load(std::memory_order_relaxed);
+}
+
+// Записывает накопленные события всех потоков; без Enable ничего не делает.
+// В процессе, запущенном через fork, файл получает суффикс .pid
+void Finish();
+
+// В процессе после fork: события основного процесса не повторяются в его файле
+void ResetAfterFork();
+
+// Время жизни объекта - событие name в потоке, где объект создан.
+// Когда запись выключена, стоит одну проверку флага.
+// name должно жить до Finish (обычно строковый литерал)
+class Scope {
+public:
+    explicit Scope(const char* name)
+        : name_(name) {
+        if (IsEnabled()) {
+            start_ = std::chrono::steady_clock::now();
+            active_ = true;
+        }
+    }
+
+    ~Scope() {
+        if (active_) {
+            details::Record(name_, start_, std::chrono::steady_clock::now());
+        }
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* name_;
+    std::chrono::steady_clock::time_point start_;
+    bool active_ = false;
+};
+
+} // namespace trace
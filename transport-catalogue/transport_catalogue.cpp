@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cstddef>
 #include <numeric>
 #include <stdexcept>
 
@@ -16,10 +17,61 @@ BusInfo::BusInfo() {
     curvature = 0.0;
 }
 
+namespace {
+
+// начальный блок арены каталога; следующие блоки растут геометрически
+constexpr size_t ARENA_INITIAL_SIZE = 64 * 1024;
+
+// буфер на стеке под уникальные остановки одного маршрута
+constexpr size_t BUS_INFO_BUFFER_SIZE = 4 * 1024;
+
+template <typename Stops>
+BusInfo CalcBusInfo(const TransportCatalogue& catalogue, const Stops& stops) {
+    BusInfo info;
+
+    // временное множество в буфере на стеке, куча нужна только длинным маршрутам
+    std::byte buffer[BUS_INFO_BUFFER_SIZE];
+    std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer));
+    std::pmr::unordered_set<const domain::Stop*> stop_storage(stops.size(), &resource);
+
+    info.stop_number = static_cast<int>(stops.size());
+
+    double geo_distance = 0;
+
+    const domain::Stop* previous = nullptr;
+    for(const domain::Stop* current : stops) {
+        stop_storage.emplace(current);
+        if(previous) {
+            info.distance += catalogue.getDistance(previous, current);
+            geo_distance += ComputeDistance(previous->coordinates, current->coordinates);
+        }
+        previous = current;
+    }
+
+    info.unique_stop_number = static_cast<int>(stop_storage.size());
+
+    info.curvature = info.distance/geo_distance;
+
+    return info;
+}
+
+} // namespace
+
 size_t HasherPair::operator()(const std::pair<const domain::Stop*, const domain::Stop*>& p) const {
     return std::hash<const void*>{}(p.first) + std::hash<const void*>{}(p.second);
 }
 
+TransportCatalogue::TransportCatalogue(std::pmr::memory_resource* upstream)
+    : m_arena(ARENA_INITIAL_SIZE, upstream)
+    , m_stops(&m_arena)
+    , m_name_to_stop(&m_arena)
+    , m_buses(&m_arena)
+    , m_name_to_bus(&m_arena)
+    , m_distance(&m_arena)
+    , m_stop_to_bus(&m_arena)
+    , m_bus_to_info(&m_arena) {
+}
+
 void TransportCatalogue::addStop(std::string_view name, geo_coord::Coordinates& coord) {
     std::string_view vname = getName(name);
 
@@ -30,6 +82,22 @@ void TransportCatalogue::addStop(std::string_view name, geo_coord::Coordinates&
     m_name_to_stop[vname] = &m_stops.back();
 }
 
+void TransportCatalogue::setCoordinates(std::string_view name, const geo_coord::Coordinates& coord) {
+    auto it = m_name_to_stop.find(name);
+    if (it == m_name_to_stop.end()) {
+        throw std::invalid_argument(__func__ + " invalid stop name"s);
+    }
+    // сама остановка хранится в m_stops и константной не является
+    const_cast<domain::Stop*>(it->second)->coordinates = coord;
+}
+
+void TransportCatalogue::reserve(size_t stop_count, size_t bus_count) {
+    m_name_to_stop.reserve(stop_count);
+    m_stop_to_bus.reserve(stop_count);
+    m_name_to_bus.reserve(bus_count);
+    m_bus_to_info.reserve(bus_count);
+}
+
 void TransportCatalogue::addBus(std::string_view name, std::string_view name_last_stop, bool is_roundtrip, const std::vector<std::string>& stops) {
     std::vector<const domain::Stop*> vector_stops;
     vector_stops.reserve(stops.size());
@@ -46,16 +114,20 @@ void TransportCatalogue::addBus(std::string_view name, std::string_view name_las
         vector_stops.emplace_back(stop);
     }
 
+    addBus(name, last_stop, is_roundtrip, vector_stops);
+}
+
+void TransportCatalogue::addBus(std::string_view name, const domain::Stop* last_stop, bool is_roundtrip, const std::vector<const domain::Stop*>& stops) {
     std::string_view vname = getName(name);
 
-    // добавляем маршрут
-    m_buses.emplace_back(domain::Bus{vname, last_stop, is_roundtrip, vector_stops});
+    // добавляем маршрут, остановки копируются в арену
+    m_buses.emplace_back(domain::Bus{vname, last_stop, is_roundtrip, {stops.begin(), stops.end(), &m_arena}});
 
     // добавляем маршрут
     m_name_to_bus[vname] = &m_buses.back();
 
     // добавляем автобус к остановке
-    for(auto stop : vector_stops) {
+    for(auto stop : m_buses.back().stops) {
         m_stop_to_bus[stop].emplace(&m_buses.back());
     }
 }
@@ -65,33 +137,36 @@ void TransportCatalogue::addBusInfo(const domain::Bus* bus, const BusInfo& info)
 }
 
 const domain::Bus* TransportCatalogue::findBus(std::string_view name) const {
-    return (m_name_to_bus.count(name) > 0) ? m_name_to_bus.at(name) : nullptr;
+    auto it = m_name_to_bus.find(name);
+    return (it != m_name_to_bus.end()) ? it->second : nullptr;
 }
 
 const domain::Stop* TransportCatalogue::findStop(std::string_view name) const {
-    return (m_name_to_stop.count(name) > 0) ? m_name_to_stop.at(name) : nullptr;
+    auto it = m_name_to_stop.find(name);
+    return (it != m_name_to_stop.end()) ? it->second : nullptr;
 }
 
-const BusInfo TransportCatalogue::getBusInfo(const domain::Bus* bus) {
-    if(!bus) {
-        throw std::invalid_argument(__func__ + " invalid bus pointer"s);
-    }
-    return m_bus_to_info.at(bus);
+const BusInfo* TransportCatalogue::findBusInfo(const domain::Bus* bus) const {
+    auto it = m_bus_to_info.find(bus);
+    return (it != m_bus_to_info.end()) ? &it->second : nullptr;
 }
 
-const BusInfo TransportCatalogue::getBusInfo(const std::string_view name) {
-    return getBusInfo(findBus(name));
+const BusInfo* TransportCatalogue::findBusInfo(std::string_view name) const {
+    const domain::Bus* bus = findBus(name);
+    return bus ? findBusInfo(bus) : nullptr;
 }
 
-int TransportCatalogue::getBusesNumOnStop(const domain::Stop* stop) const {
-    if(!stop) {
-        throw std::invalid_argument(__func__ + " invalid stop pointer"s);
-    }
-    return static_cast<int>(m_stop_to_bus.count(stop));
+BusInfo TransportCatalogue::calcBusInfo(const std::vector<const domain::Stop*>& stops) const {
+    return CalcBusInfo(*this, stops);
+}
+
+BusInfo TransportCatalogue::calcBusInfo(const std::pmr::vector<const domain::Stop*>& stops) const {
+    return CalcBusInfo(*this, stops);
 }
 
-std::vector<const domain::Bus*> TransportCatalogue::getBusesOnStop(const domain::Stop* stop) {
-    return {m_stop_to_bus.at(stop).begin(), m_stop_to_bus.at(stop).end()};
+const std::pmr::unordered_set<domain::Bus*>* TransportCatalogue::findBusesOnStop(const domain::Stop* stop) const {
+    auto it = m_stop_to_bus.find(stop);
+    return (it != m_stop_to_bus.end()) ? &it->second : nullptr;
 }
 
 void TransportCatalogue::setDistance(const std::string& str_stop_from, const std::string& str_stop_to, int distance) {
@@ -99,6 +174,10 @@ void TransportCatalogue::setDistance(const std::string& str_stop_from, const std
     const domain::Stop* stop_from = findStop(str_stop_from);
     const domain::Stop* stop_to = findStop(str_stop_to);
 
+    setDistance(stop_from, stop_to, distance);
+}
+
+void TransportCatalogue::setDistance(const domain::Stop* stop_from, const domain::Stop* stop_to, int distance) {
     if((nullptr == stop_from) || (nullptr == stop_to)) {
         return;
     }
@@ -126,21 +205,23 @@ int TransportCatalogue::getDistance(const domain::Stop* stop_from, const domain:
     return m_distance.at(key_forward);
 }
 
-const std::unordered_map<std::string_view, const domain::Stop*>& TransportCatalogue::getStops() const {
+const std::pmr::unordered_map<std::string_view, const domain::Stop*>& TransportCatalogue::getStops() const {
     return m_name_to_stop;
 }
 
-const std::unordered_map<std::string_view, const domain::Bus*>& TransportCatalogue::getBuses() const {
+const std::pmr::unordered_map<std::string_view, const domain::Bus*>& TransportCatalogue::getBuses() const {
     return m_name_to_bus;
 }
 
-const std::unordered_map<const domain::Stop*, std::unordered_set<domain::Bus*>>& TransportCatalogue::getStopToBuses() const {
+const std::pmr::unordered_map<const domain::Stop*, std::pmr::unordered_set<domain::Bus*>>& TransportCatalogue::getStopToBuses() const {
     return m_stop_to_bus;
 }
 
 std::string_view TransportCatalogue::getName(std::string_view str) {
-    m_name_to_storage.emplace_back(static_cast<std::string>(str));
-    return m_name_to_storage.back();
+    char* data = static_cast<char*>(m_arena.allocate(str.size(), alignof(char)));
+    std::copy(str.begin(), str.end(), data);
+    m_names_bytes += str.size();
+    return {data, str.size()};
 }
 
 void TransportCatalogue::addStopDistance(const std::string& stop_name, std::vector<std::pair<int, std::string>>& vct_distance) {
@@ -151,4 +232,40 @@ const std::unordered_map<std::string, std::vector<std::pair<int, std::string>>>&
     return m_stop_to_dist;
 }
 
+memory::Usage TransportCatalogue::memoryUsage() const {
+    memory::Usage usage("catalogue"s);
+
+    usage.Add("names"s, m_names_bytes);
+
+    usage.Add("stops"s, memory::DequeBytes(m_stops) + memory::HashBytes(m_name_to_stop));
+
+    size_t buses = memory::DequeBytes(m_buses) + memory::HashBytes(m_name_to_bus);
+    for (const auto& bus : m_buses) {
+        buses += memory::VectorBytes(bus.stops);
+    }
+    usage.Add("buses"s, buses);
+
+    usage.Add("distances"s, memory::HashBytes(m_distance));
+
+    size_t stop_to_bus = memory::HashBytes(m_stop_to_bus);
+    for (const auto& [stop, buses_on_stop] : m_stop_to_bus) {
+        stop_to_bus += memory::HashBytes(buses_on_stop);
+    }
+    usage.Add("stop_to_bus"s, stop_to_bus);
+
+    usage.Add("bus_info"s, memory::HashBytes(m_bus_to_info));
+
+    // расстояния в том виде, в котором прочитаны, нужны для сериализации
+    size_t stop_to_dist = memory::HashBytes(m_stop_to_dist);
+    for (const auto& [name, distances] : m_stop_to_dist) {
+        stop_to_dist += memory::StringBytes(name) + memory::VectorBytes(distances);
+        for (const auto& [distance, stop_name] : distances) {
+            stop_to_dist += memory::StringBytes(stop_name);
+        }
+    }
+    usage.Add("stop_to_dist"s, stop_to_dist);
+
+    return usage;
+}
+
 } // namespace transport_catalogue
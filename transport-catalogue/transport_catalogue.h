@@ -6,10 +6,12 @@
 #include <deque>
 #include <set>
 #include <map>
+#include <memory_resource>
 #include <unordered_set>
 #include <unordered_map>
 
 #include "domain.h"
+#include "memory.h"
 
 namespace transport_catalogue {
 
@@ -27,15 +29,26 @@ struct HasherPair {
     size_t operator()(const std::pair<const domain::Stop*, const domain::Stop*>& p) const;
 };
 
+// Все данные каталога (имена, остановки, маршруты, таблицы) живут в собственной
+// монотонной арене: выделение - сдвиг указателя, освобождение - разом вместе
+// с каталогом. Добавлять данные можно только из одного потока
 class TransportCatalogue {
 public:
-    TransportCatalogue() = default;
+    // upstream - откуда арена берет крупные блоки
+    explicit TransportCatalogue(std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
 
     // добавить остановку
     void addStop(std::string_view name, geo_coord::Coordinates& coord);
 
+    // изменить координаты добавленной остановки; маршрутов и ответов не касается
+    void setCoordinates(std::string_view name, const geo_coord::Coordinates& coord);
+
+    // зарезервировать место под остановки и маршруты
+    void reserve(size_t stop_count, size_t bus_count);
+
     // добавить маршрут
     void addBus(std::string_view name, std::string_view name_last_stop, bool is_roundtrip, const std::vector<std::string>& stops);
+    void addBus(std::string_view name, const domain::Stop* last_stop, bool is_roundtrip, const std::vector<const domain::Stop*>& stops);
 
     // добавить информацию о маршруте
     void addBusInfo(const domain::Bus* bus, const BusInfo& info);
@@ -46,28 +59,32 @@ public:
     // поиск маршрута по имени
     const domain::Bus* findBus(std::string_view name) const;
 
-    // получение информации о маршруте
-    const BusInfo getBusInfo(const domain::Bus* bus);
-    const BusInfo getBusInfo(const std::string_view name);
+    // поиск информации о маршруте: nullptr, если маршрута нет
+    const BusInfo* findBusInfo(const domain::Bus* bus) const;
+    const BusInfo* findBusInfo(std::string_view name) const;
+
+    // вычисление информации о маршруте по списку остановок
+    BusInfo calcBusInfo(const std::vector<const domain::Stop*>& stops) const;
+    BusInfo calcBusInfo(const std::pmr::vector<const domain::Stop*>& stops) const;
 
-    // получение информации о автобусах проходящих через остановку
-    int getBusesNumOnStop(const domain::Stop* stop) const;
-    std::vector<const domain::Bus*> getBusesOnStop(const domain::Stop* stop);
+    // автобусы через остановку: nullptr, если их нет или нет остановки
+    const std::pmr::unordered_set<domain::Bus*>* findBusesOnStop(const domain::Stop* stop) const;
 
     // установить расстояние между остановок
     void setDistance(const std::string& stop_from, const std::string& stop_to, int distance);
+    void setDistance(const domain::Stop* stop_from, const domain::Stop* stop_to, int distance);
 
     // получить рассояние между остановок
     int getDistance(const domain::Stop* stop_from, const domain::Stop* stop_to) const;
 
     // получить мапу для остановки: имя - указатель
-    const std::unordered_map<std::string_view, const domain::Stop*>& getStops() const;
+    const std::pmr::unordered_map<std::string_view, const domain::Stop*>& getStops() const;
 
     // получить мапу для маршрута: имя - указатель
-    const std::unordered_map<std::string_view, const domain::Bus*>& getBuses() const;
+    const std::pmr::unordered_map<std::string_view, const domain::Bus*>& getBuses() const;
 
     // получить мапу для остановки: остановка - маршруты
-    const std::unordered_map<const domain::Stop*, std::unordered_set<domain::Bus*>>& getStopToBuses() const;
+    const std::pmr::unordered_map<const domain::Stop*, std::pmr::unordered_set<domain::Bus*>>& getStopToBuses() const;
 
     // добавить расстояния для остановки
     void addStopDistance(const std::string& stop_name, std::vector<std::pair<int, std::string>>& vct_distance);
@@ -75,28 +92,34 @@ public:
     // получить мапу расстояний для остановок
     const std::unordered_map<std::string, std::vector<std::pair<int, std::string>>>& getStopDistance();
 
+    // оценка памяти в куче по таблицам каталога
+    memory::Usage memoryUsage() const;
+
 private:
-    // здесь живут все имена (сюда показывает string_view)
-    std::deque<std::string> m_name_to_storage;
+    // арена объявлена первой и освобождается после всех контейнеров
+    std::pmr::monotonic_buffer_resource m_arena;
+
+    // байт под имена в арене (сюда показывает string_view)
+    size_t m_names_bytes = 0;
 
     // остановки
-    std::deque<domain::Stop> m_stops;
-    std::unordered_map<std::string_view, const domain::Stop*> m_name_to_stop;
+    std::pmr::deque<domain::Stop> m_stops;
+    std::pmr::unordered_map<std::string_view, const domain::Stop*> m_name_to_stop;
 
     // маршруты
-    std::deque<domain::Bus> m_buses;
-    std::unordered_map<std::string_view, const domain::Bus*> m_name_to_bus;
+    std::pmr::deque<domain::Bus> m_buses;
+    std::pmr::unordered_map<std::string_view, const domain::Bus*> m_name_to_bus;
 
     // расстояния между остановками
-    std::unordered_map<std::pair<const domain::Stop*, const domain::Stop*>, int, HasherPair> m_distance;
+    std::pmr::unordered_map<std::pair<const domain::Stop*, const domain::Stop*>, int, HasherPair> m_distance;
 
     // таблица для получения автобусов проходящих через остановку
-    std::unordered_map<const domain::Stop*, std::unordered_set<domain::Bus*>> m_stop_to_bus;
+    std::pmr::unordered_map<const domain::Stop*, std::pmr::unordered_set<domain::Bus*>> m_stop_to_bus;
 
     // таблица для получения информации о маршруте
-    std::unordered_map<const domain::Bus*, BusInfo> m_bus_to_info;
+    std::pmr::unordered_map<const domain::Bus*, BusInfo> m_bus_to_info;
 
-    // таблица расстояний
+    // таблица расстояний в том виде, в котором ее передал читатель (не в арене)
     std::unordered_map<std::string, std::vector<std::pair<int, std::string>>> m_stop_to_dist;
 
     std::string_view getName(std::string_view str);
@@ -1,7 +1,25 @@
 #include "transport_router.h"
 
+#include <algorithm>
+
+#include "trace.h"
+
 namespace transport_router {
 
+namespace {
+
+// значения таблицы имя - указатель в порядке имен: нумерация вершин и порядок
+// ребер, а с ними и выбор среди равных по времени маршрутов, не зависят
+// от порядка обхода хэш-таблицы
+template <typename Map>
+auto SortedByName(const Map& map) {
+    std::vector<std::pair<std::string_view, typename Map::mapped_type>> items(map.begin(), map.end());
+    std::sort(items.begin(), items.end());
+    return items;
+}
+
+} // namespace
+
 // ---> RouteProperties
 
 RouteProperties::RouteProperties(int stops_number, double waiting_time, double travel_time) :
@@ -86,8 +104,10 @@ const RouterSettings& TransportRouter::GetSettings() const {
 }
 
 void TransportRouter::CalcRoute() {
+    trace::Scope scope("CalcRoute");
+
     // все остановки
-    const auto& stops = catalogue_.getStops();
+    const auto stops = SortedByName(catalogue_.getStops());
 
     graph_ = std::make_unique<graph::DirectedWeightedGraph<RouteProperties>>(stops.size());
 
@@ -99,7 +119,7 @@ void TransportRouter::CalcRoute() {
     }
 
     // все маршруты
-    const auto& buses = catalogue_.getBuses();
+    const auto buses = SortedByName(catalogue_.getBuses());
 
     // добавляем все маршруты
     for (const auto& [bus_name, bus_ptr] : buses) {
@@ -136,6 +156,8 @@ void TransportRouter::CalcRoute() {
         }
     }
 
+    // все кратчайшие пути (Флойд-Уоршелл)
+    trace::Scope router_scope("FloydWarshall");
     router_ = std::make_unique<graph::Router<RouteProperties>>(*graph_);
 }
 
@@ -184,6 +206,17 @@ TransportRouter::GetRoute(std::string_view from, std::string_view to) const {
     return result;
 }
 
+memory::Usage TransportRouter::MemoryUsage() const {
+    memory::Usage usage("router");
+
+    usage.Add("graph", graph_ ? graph_->MemoryUsage() : 0);
+    usage.Add("routes", router_ ? router_->MemoryUsage() : 0);
+    usage.Add("vertexes", memory::HashBytes(graph_vertexes_));
+    usage.Add("edges", memory::VectorBytes(graph_edges_));
+
+    return usage;
+}
+
 // <--- TransportRouter
 
 } // namespace transport_router
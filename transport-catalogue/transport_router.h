@@ -1,6 +1,7 @@
 #pragma once
 
 #include "graph.h"
+#include "memory.h"
 #include "router.h"
 #include "transport_catalogue.h"
 
@@ -64,6 +65,9 @@ public:
 
     std::optional<std::vector<const RouteConditions*>> GetRoute(std::string_view from, std::string_view to) const;
 
+    // оценка памяти в куче: граф, таблица путей, вершины и ребра
+    memory::Usage MemoryUsage() const;
+
 private:
     const transport_catalogue::TransportCatalogue& catalogue_;
 